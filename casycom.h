@@ -7,5 +7,6 @@
 #include "casycom/main.h"
 #include "casycom/app.h"
 #include "casycom/timer.h"
+#include "casycom/work.h"
 #include "casycom/io.h"
 #include "casycom/xsrv.h"
@@ -127,31 +127,148 @@ typedef struct _FdIO {
     Proxy	reply;
     int		fd;
     Proxy	timer;
+    enum ETimerWatchCmd	watching;	// The persistent fd watch
     bool	eof;
+    CharVector*	rring;	// The rbuf being read through the io ring
+    CharVector*	wring;	// ... and the wbuf written
     CharVector*	rbuf;
     CharVector*	wbuf;
+#if USE_IO_URING
+    Proxy	selfp;	// Ring completions are handled in a TimerR.timer to self
+    int		rres;	// Result of the completed ring read
+    int		wres;	// ... and write
+    bool	rdone;	// The ring read completed, not yet handled
+    bool	wdone;	// ... and the ring write
+#endif
 } FdIO;
 
 const Factory f_FdIO;
 
-static void* FdIO_create (const Msg* msg)
+static void FdIO_init (void* vo, const Msg* msg)
 {
-    FdIO* po = xalloc (sizeof(FdIO));
+    FdIO* po = vo;
     po->fd = -1;
     po->reply = casycom_create_reply_proxy (&i_IOR, msg);
     po->timer = casycom_create_proxy (&i_Timer, msg->h.dest);
-    return po;
+#if USE_IO_URING
+    po->selfp = casycom_create_proxy_to (&i_TimerR, msg->h.dest, msg->h.dest);
+#endif
+}
+
+static void FdIO_destroy (void* vo UNUSED)
+{
+#if USE_IO_URING
+    Timer_uring_cancel (vo);
+#endif
 }
 
 static void FdIO_FdIO_attach (FdIO* o, int fd)
 {
+    // Transfers on a previously attached fd are stopped
+    if (o->watching) {
+	o->watching = WATCH_STOP;
+	PTimer_stop (&o->timer);
+    }
+#if USE_IO_URING
+    if (o->rdone && o->rres > 0)	// Data already read is still reported
+	PIOR_read (&o->reply, o->rring);
+    if (o->rring || o->wring) {
+	Timer_uring_cancel (o);
+	o->rring = o->wring = NULL;
+	o->rdone = o->wdone = false;
+    }
+#endif
     o->fd = fd;
 }
 
+#if USE_IO_URING
+static void FdIO_ring_read (void* vo, int r, const void* d);
+static void FdIO_ring_written (void* vo, int r, const void* d);
+
+// Queues transfers on the io ring. When it is not available, or busy,
+// they are done when the fd is ready.
+static void FdIO_submit (FdIO* o)
+{
+    if (o->eof)
+	return;
+    if (o->rbuf && !o->rring && o->rbuf->size < o->rbuf->allocated && Timer_uring_read (o->fd, o->rbuf->allocated - o->rbuf->size, FdIO_ring_read, o))
+	o->rring = o->rbuf;
+    if (o->wbuf && !o->wring && o->wbuf->size && Timer_uring_write (o->fd, o->wbuf->d, o->wbuf->size, FdIO_ring_written, o))
+	o->wring = o->wbuf;
+}
+
+// The ring completion functions are called while the Timer waits for
+// events. They only record the result, and leave the rest to a message
+// to self, handled like any other by FdIO_TimerR_timer.
+static void FdIO_ring_complete (FdIO* o)
+{
+    if (!o->rdone && !o->wdone)
+	PTimerR_timer (&o->selfp, o->fd);
+}
+
+static void FdIO_ring_read (void* vo, int r, const void* d)
+{
+    FdIO* o = vo;
+    FdIO_ring_complete (o);
+    // The data goes to the buffer the read was queued for, even if rbuf
+    // has since been replaced.
+    if (r > 0) {
+	vector_reserve (o->rring, o->rring->size + r);
+	memcpy (vector_end (o->rring), d, r);
+	o->rring->size += r;
+    }
+    o->rres = r;
+    o->rdone = true;
+}
+
+static void FdIO_ring_written (void* vo, int r, const void* d UNUSED)
+{
+    FdIO* o = vo;
+    FdIO_ring_complete (o);
+    if (r > 0)
+	vector_erase_n (o->wring, 0, r);
+    o->wres = r;
+    o->wdone = true;
+}
+
+static inline bool FdIO_ring_failed (int r)
+    { return r <= 0 && r != -EINTR && r != -EAGAIN; }
+
+// Reports completed ring transfers, and queues the next ones
+static void FdIO_ring_done (FdIO* o)
+{
+    bool failed = false;
+    if (o->rdone) {
+	CharVector* rring = o->rring;
+	o->rring = NULL;
+	o->rdone = false;
+	if (o->rres > 0)	// Reported before the next read is queued
+	    PIOR_read (&o->reply, rring);
+	failed |= FdIO_ring_failed (o->rres);
+    }
+    if (o->wdone) {
+	CharVector* wring = o->wring;
+	o->wring = NULL;
+	o->wdone = false;
+	if (o->wres > 0 && !wring->size) {
+	    PIOR_written (&o->reply, wring);
+	    if (wring == o->wbuf)
+		o->wbuf = NULL;
+	}
+	failed |= FdIO_ring_failed (o->wres);
+    }
+    if (!failed)	// eof and errors are handled by the synchronous path
+	FdIO_submit (o);
+}
+#endif
+
 static void FdIO_TimerR_timer (FdIO* o, int fd UNUSED, const Msg* msg UNUSED)
 {
+#if USE_IO_URING
+    FdIO_ring_done (o);
+#endif
     enum ETimerWatchCmd ccmd = 0;
-    if (o->rbuf) {
+    if (o->rbuf && !o->rring) {
 	if (!o->eof) {
 	    size_t rbufsz = o->rbuf->size;
 	    for (size_t btr; 0 < (btr = o->rbuf->allocated - o->rbuf->size);) {
@@ -176,7 +293,7 @@ static void FdIO_TimerR_timer (FdIO* o, int fd UNUSED, const Msg* msg UNUSED)
 	if (o->eof)
 	    PIOR_read (&o->reply, o->rbuf = NULL);
     }
-    if (o->wbuf) {
+    if (o->wbuf && !o->wring) {
 	if (!o->eof) {
 	    size_t wbufsize = o->wbuf->size;
 	    while (o->wbuf->size) {
@@ -203,19 +320,31 @@ static void FdIO_TimerR_timer (FdIO* o, int fd UNUSED, const Msg* msg UNUSED)
 	if (o->eof)
 	    PIOR_written (&o->reply, o->wbuf = NULL);
     }
+    // The watch stays set while the transfers block, and is only changed
+    // when they start or stop blocking.
     if (ccmd)
+	ccmd |= WATCH_PERSISTENT;
+    if (ccmd != o->watching) {
+	o->watching = ccmd;
 	PTimer_watch (&o->timer, ccmd, o->fd, TIMER_NONE);
+    }
 }
 
 static void FdIO_IO_read (FdIO* o, CharVector* d)
 {
     o->rbuf = d;
+#if USE_IO_URING
+    FdIO_submit (o);
+#endif
     FdIO_TimerR_timer (o, o->fd, NULL);
 }
 
 static void FdIO_IO_write (FdIO* o, CharVector* d)
 {
     o->wbuf = d;
+#if USE_IO_URING
+    FdIO_submit (o);
+#endif
     FdIO_TimerR_timer (o, o->fd, NULL);
 }
 
@@ -233,7 +362,9 @@ static const DTimerR d_FdIO_TimerR = {
     DMETHOD (FdIO, TimerR_timer)
 };
 const Factory f_FdIO = {
-    .create = FdIO_create,
+    .init = FdIO_init,
+    .destroy = FdIO_destroy,
+    .object_size = sizeof(FdIO),
     .dtable = { &d_FdIO_FdIO, &d_FdIO_IO, &d_FdIO_TimerR, NULL }
 };
 
@@ -9,6 +9,8 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
 
 //{{{ Module globals ---------------------------------------------------
 
@@ -16,69 +18,231 @@
 static unsigned _casycom_last_signal = 0;
 static pid_t _casycom_last_child_pid = 0;
 static int _casycom_last_child_status = 0;
-// Loop exit code
-static int _casycom_exit_code = EXIT_SUCCESS;
-// Loop status
-static bool _casycom_quitting = false;
-// Output queue modification lock
-static _Atomic(bool) _casycom_output_queue_lock = false;
-// Last error
-static char* _casycom_error = NULL;
-// App proxy
-static Proxy _casycom_appp = {};
 // Enables debug trace messages
 bool casycom_debug_msg_trace = false;
 
 // Message queues
 DECLARE_VECTOR_TYPE (MsgVector, Msg*);
-static VECTOR (MsgVector, _casycom_input_queue);	// During each main loop iteration, this queue is read
-static VECTOR (MsgVector, _casycom_output_queue);	// ... and this queue is written. Then they are swapped.
 
-// Object table contains object factories and the dtables they support
-DECLARE_VECTOR_TYPE (FactoryTable, const Factory*);
-static VECTOR (FactoryTable, _casycom_object_table);
-static const Factory* _casycom_default_object = NULL;
+// Objects of factories registered with casycom_register_threaded receive
+// their messages on worker threads, when enabled by casycom_enable_workers.
+// The loop thread moves each message for such an object into the object's
+// mailbox, and the mailbox is put on the run queue of a worker. Only one
+// worker runs a mailbox at a time, so messages are delivered in order.
+// Objects created by a threaded object are pinned to its worker, along
+// with the creator, so a creator subtree shares a worker. Unpinned objects
+// can be taken by any idle worker.
+typedef struct _MailboxEntry {
+    Msg*		msg;
+    const DTable*	dtable;
+} MailboxEntry;
+DECLARE_VECTOR_TYPE (MailboxQueue, MailboxEntry);
+typedef struct _Mailbox {
+    struct _Mailbox*	next;	// In the worker result stack
+    void*		o;
+    MailboxQueue	msgs;
+    char*		error;	// Set by casycom_error on the worker
+    oid_t		oid;
+    uint16_t		holds;	// When held by the loop thread, the mailbox is not run
+    uint16_t		worker;	// Index of the worker whose run queue gets it,
+    bool		pinned;	// ... and whether another worker may take it; both guarded by workers_lock
+    _Atomic(bool)	lock;	// Guards the fields below, msgs, error, and holds
+    bool		queued;	// In a run queue, or running
+    bool		running;
+    bool		unused;	// Set by casycom_mark_unused on the worker
+    bool		reported;	// In the worker result stack
+    bool		dead;	// The object was destroyed
+} Mailbox;
+DECLARE_VECTOR_TYPE (MailboxVector, Mailbox*);
+typedef struct _Worker {
+    pthread_t		thread;
+    MailboxVector	runq;	// Guarded by workers_lock
+    CasycomContext*	ctx;
+} Worker;
+DECLARE_VECTOR_TYPE (WorkerVector, Worker);
+static _Thread_local Mailbox* _casycom_worker_mailbox = NULL;
+
+// Object table contains object factories and the dtables they support.
+// Each registered interface is assigned a dense index, and each factory
+// entry has an array of its dtables indexed by it, so that finding the
+// dtable for a message requires no scanning. Entry 0 in both tables is
+// reserved for "none"; unregistered interfaces have index 0.
+DECLARE_VECTOR_TYPE (DTableVector, const DTable*);
+DECLARE_VECTOR_TYPE (SlabVector, void*);
+typedef struct _FactoryEntry {
+    const Factory*	factory;
+    DTableVector	dtables;	// indexed by interface index
+    void*		free_objects;	// Pooled objects, when factory->object_size is set,
+    SlabVector		slabs;		// ... allocated in slabs and linked through the first word.
+    bool		threaded;	// Objects are run on worker threads
+} FactoryEntry;
+DECLARE_VECTOR_TYPE (FactoryTable, FactoryEntry);
+
+typedef struct _InterfaceEntry {
+    iid_t	iid;
+    uint16_t	ifactory;	// First registered factory implementing iid
+} InterfaceEntry;
+DECLARE_VECTOR_TYPE (InterfaceTable, InterfaceEntry);
+
+// iindex maps interface pointers to interface indexes, and nindex maps
+// interface names to the same, for resolving the names in messages
+// received from other processes. Both are hash indexes, with 0 in empty
+// buckets.
+DECLARE_HASH_INDEX_TYPE (IIndex, uint16_t);
+DECLARE_HASH_INDEX_TYPE (NIndex, uint16_t);
 
 // Message link map
 typedef enum _OFlags {
     f_Unused,	// Objects marked unused are deleted during loop idle
+    f_Free,	// The slot is in the free oid list
     f_Last
 } OFlags;
-typedef struct _MsgLink {
+DECLARE_VECTOR_TYPE (ProxyVector, Proxy);
+DECLARE_VECTOR_TYPE (OidVector, oid_t);
+typedef struct _OSlot {
     void*		o;
-    const Factory*	factory;
-    Proxy		h;
+    ProxyVector		links;
+    OidVector		outlinks;	// Destinations of links from this object
     uint32_t		flags;
-} MsgLink;
-DECLARE_VECTOR_TYPE (SOMap, MsgLink);
-
-// _casycom_omap contains the message routing table, mapping each
-// proxy-to-object link. The map is sorted by object id. Each object
-// may have multiple incoming and outgoing links. The block of incoming
-// links is contiguous, being sorted, and the first link contains the
-// object pointer (ml->o). The other links have o set to NULL, and are
-// ordered by the order of creation of their proxies. The first
-// link is created by the first proxy created to this object, and is
-// considered to be the creator link. The creator path is used for error
-// handling propagation. Once the creator object is destroyed, all
-// objects created by it are also destroyed.
-static VECTOR (SOMap, _casycom_omap);
+    uint16_t		gen;		// Incremented every time the oid is freed
+    oid_t		nextfree;	// Next oid in the free list
+    uint16_t		ifactory;	// Index of the factory in the object table
+    Mailbox*		mailbox;	// For objects run on worker threads
+    uint32_t		nqueued;	// Messages to it waiting in the queues
+    uint32_t		nposted;	// ... and ever queued, delivered in order
+} OSlot;
+DECLARE_VECTOR_TYPE (OMap, OSlot);
+
+// The omap contains the message routing table, mapping each
+// proxy-to-object link. The map is indexed by object id, each slot
+// containing the object pointer, its factory index, and the list of incoming
+// links, ordered by the order of creation of their proxies. A slot
+// with no links is unused and its oid can be allocated to a new object.
+// The first link is created by the first proxy created to this object,
+// and is considered to be the creator link. The creator path is used
+// for error handling propagation. Once the creator object is destroyed,
+// all objects created by it are also destroyed. Each slot also lists the
+// destinations of its outgoing links, one entry per link, so they can be
+// found without scanning the map.
+//
+// Freed oids are kept in a FIFO list threaded through the slots. They
+// are reused only after c_OidReuseDelay of them accumulate, or when all
+// oids have been allocated, to keep the reused oid from being confused
+// with the old object. Slot generation counters, copied into each proxy
+// and message, catch the remaining cases, so stale messages are dropped.
+enum { c_OidReuseDelay = 64 };
+
+// oindex maps object pointers to oids, for casycom_oid_of_object
+// and casycom_mark_unused. It is a hash index of oids, hashed by the
+// object pointer in the oid's slot. Empty buckets contain oid_Broadcast.
+DECLARE_HASH_INDEX_TYPE (OIndex, oid_t);
+
+// All the state of a message loop is kept in a context, so that several
+// independent loops can run in one process, each on its own thread.
+// Each thread has a current context, initially the main context.
+struct _CasycomContext {
+    int			exit_code;	// Loop exit code
+    bool		quitting;	// Loop status
+    char*		error;		// Last error
+    Proxy		appp;		// App proxy
+    MsgVector		input_queue;	// During each main loop iteration, this queue is read
+    MsgVector		output_queue;	// ... and this queue is written. Then they are swapped.
+    // The output queue is written only by the loop thread. Messages queued
+    // by other threads are pushed onto a lock-free stack, linked through
+    // Msg.next, and moved to the output queue before it is swapped. Pushing
+    // onto an empty stack signals the wakeup fd, polled by Timer_run_timer.
+    _Atomic(Msg*)	foreign_queue;
+    int			wakeup_fd;
+    // When enabled, messages created during each pass are allocated from
+    // message arena (pass%2), reset at the end of the next pass.
+    bool		msg_arena;
+    unsigned		pass;
+    FactoryTable	object_table;
+    const Factory*	default_object;
+    uint16_t		default_ifactory;
+    InterfaceTable	interfaces;
+    IIndex		iindex;
+    NIndex		nindex;
+    OMap		omap;
+    OidVector		unused;		// Objects marked unused, in order of marking, to be destroyed during idle
+    oid_t		free_first;
+    oid_t		free_last;
+    size_t		nfree;
+    oid_t		next_oid;	// Lowest never allocated oid
+    OIndex		oindex;
+    WorkerVector	workers;
+    pthread_mutex_t	workers_lock;
+    pthread_cond_t	workers_cond;
+    bool		workers_stop;
+    unsigned		next_worker;
+    // Messages moved to mailboxes and not yet delivered, and work counted
+    // with casycom_async_begin; the loop does not quit while any remain.
+    _Atomic(size_t)	worker_pending;
+    pthread_cond_t	async_cond;	// Signalled by casycom_async_end, for casycom_reset
+    // Mailboxes whose objects called casycom_mark_unused or casycom_error,
+    // pushed like the foreign queue, for the loop thread to act on.
+    _Atomic(Mailbox*)	worker_results;
+    void*		slots [CASYCOM_CONTEXT_SLOTS];	// State of other modules
+};
+
+#define CASYCOM_CONTEXT_INIT {\
+    .exit_code		= EXIT_SUCCESS,\
+    .input_queue	= VECTOR_INIT (MsgVector),\
+    .output_queue	= VECTOR_INIT (MsgVector),\
+    .wakeup_fd		= -1,\
+    .object_table	= VECTOR_INIT (FactoryTable),\
+    .interfaces		= VECTOR_INIT (InterfaceTable),\
+    .iindex		= HASH_INDEX_INIT (IIndex),\
+    .nindex		= HASH_INDEX_INIT (NIndex),\
+    .omap		= VECTOR_INIT (OMap),\
+    .unused		= VECTOR_INIT (OidVector),\
+    .next_oid		= oid_First,\
+    .oindex		= HASH_INDEX_INIT (OIndex),\
+    .workers		= VECTOR_INIT (WorkerVector),\
+    .workers_lock	= PTHREAD_MUTEX_INITIALIZER,\
+    .workers_cond	= PTHREAD_COND_INITIALIZER,\
+    .async_cond		= PTHREAD_COND_INITIALIZER\
+}
+static CasycomContext _casycom_main_context = CASYCOM_CONTEXT_INIT;
+static _Thread_local CasycomContext* _casycom_ctx = &_casycom_main_context;
+// The context whose loop runs on this thread, set by casycom_init
+static _Thread_local CasycomContext* _casycom_loop_ctx = NULL;
+// The context receiving signals, set by casycom_framework_init
+static CasycomContext* _casycom_signal_ctx = NULL;
 
 //----------------------------------------------------------------------
 // Local private functions
 
-static MsgLink* casycom_find_destination (oid_t doid);
-static MsgLink* casycom_find_or_create_destination (const Msg* msg);
-static MsgLink* casycom_link_for_object (const void* o);
-static const DTable* casycom_find_dtable (const Factory* o, iid_t iid);
-static const Factory* casycom_find_factory (iid_t iid);
+static OSlot* casycom_find_destination (oid_t doid);
+static OSlot* casycom_find_or_create_destination (const Msg* msg);
+static OSlot* casycom_link_for_object (const void* o);
+static const DTable* casycom_find_dtable (const OSlot* ol, iid_t iid);
+static uint16_t casycom_find_factory (iid_t iid);
+static uint16_t casycom_interface_index (iid_t iid);
+static inline const Factory* casycom_slot_factory (const OSlot* ol);
 static size_t casycom_link_for_proxy (const Proxy* ph);
-static size_t casycom_omap_lower_bound (oid_t oid);
-static void* casycom_create_link_object (MsgLink* ml, const Msg* msg);
-static void casycom_destroy_link_at (size_t l);
-static void casycom_destroy_object (MsgLink* ol);
+static OSlot* casycom_omap_slot (oid_t oid);
+static oid_t casycom_allocate_oid (void);
+static void casycom_free_oid (oid_t oid);
+static void* casycom_create_link_object (OSlot* ml, const Msg* msg);
+static void* casycom_alloc_pooled_object (uint16_t ifactory);
+static void casycom_free_pooled_object (uint16_t ifactory, void* o);
+static void casycom_destroy_link_at (oid_t oid, size_t l);
+static void casycom_destroy_object (oid_t oid);
 static void casycom_do_message_queues (void);
+static void casycom_queue_foreign_message (Msg* msg);
+static inline void casycom_count_queued (const Msg* msg);
+static inline void casycom_count_delivered (const Msg* msg);
 static void casycom_idle (void);
+static void casycom_create_mailbox (OSlot* ml);
+static void casycom_post_to_mailbox (Mailbox* mb, const DTable* dtable, Msg* msg);
+static void casycom_mailbox_hold (Mailbox* mb);
+static void casycom_mailbox_unhold (Mailbox* mb);
+static void casycom_mailbox_destroy (Mailbox* mb);
+static void casycom_take_worker_results (void);
+static void casycom_stop_workers (void);
+static void casycom_wait_for_workers (void);
+static void casycom_wake_loop (void);
 
 //}}}-------------------------------------------------------------------
 //{{{ Signal handling
@@ -118,8 +282,10 @@ static void casycom_on_msg_signal (int sig)
     _casycom_last_signal = sig;
     if (sig == SIGCHLD)
 	_casycom_last_child_pid = waitpid (-1, &_casycom_last_child_status, WNOHANG);
-    else if (S(sig) & sigset_Quit)
-	casycom_quit (qc_ShellSignalQuitOffset+sig);
+    else if (S(sig) & sigset_Quit && _casycom_signal_ctx) {
+	_casycom_signal_ctx->exit_code = qc_ShellSignalQuitOffset+sig;
+	_casycom_signal_ctx->quitting = true;
+    }
 }
 
 static void casycom_install_signal_handlers (void)
@@ -135,11 +301,11 @@ static void casycom_install_signal_handlers (void)
 
 static inline void casycom_send_signal_message (void)
 {
-    if (!_casycom_last_signal)
+    if (!_casycom_last_signal || _casycom_ctx != _casycom_signal_ctx)
 	return;
     alarm (0);	// the alarm was set to check for infinite loops
-    if (_casycom_appp.interface)
-	PApp_signal (&_casycom_appp, _casycom_last_signal, _casycom_last_child_pid, _casycom_last_child_status);
+    if (_casycom_ctx->appp.interface)
+	PApp_signal (&_casycom_ctx->appp, _casycom_last_signal, _casycom_last_child_pid, _casycom_last_child_status);
     _casycom_last_signal = 0;
 }
 
@@ -149,100 +315,156 @@ static inline void casycom_send_signal_message (void)
 /// creates a proxy to a new object from object \p src, using interface \p iid
 Proxy casycom_create_proxy (iid_t iid, oid_t src)
 {
-    // Find first unused oid value
-    // OMap is sorted, so increment nid until a number gap is found
-    oid_t nid = oid_First;
-    if (_casycom_omap.size)
-	nid = _casycom_omap.d[0].h.dest;
-    size_t ip = 0;
-    for (; ip < _casycom_omap.size; ++ip) {
-	if (nid < _casycom_omap.d[ip].h.dest)
-	    break;
-	if (nid == _casycom_omap.d[ip].h.dest)
-	    ++nid;
-    }
-    return casycom_create_proxy_to (iid, src, nid);
+    return casycom_create_proxy_to (iid, src, casycom_allocate_oid());
 }
 
 /// creates a proxy to existing object \p dest from \p src, using interface \p iid
 Proxy casycom_create_proxy_to (iid_t iid, oid_t src, oid_t dest)
 {
-    size_t ip = casycom_omap_lower_bound (dest);
-    while (ip < _casycom_omap.size && _casycom_omap.d[ip].h.dest == dest)
-	++ip;
-    MsgLink* e = vector_emplace (&_casycom_omap, ip);
-    e->factory = casycom_find_factory (iid);
-    e->h.interface = iid;
-    e->h.src = src;
-    e->h.dest = dest;
-    DEBUG_PRINTF ("[T] created proxy link %hu -> %hu.%s\n", e->h.src, e->h.dest, e->h.interface->name);
-    return e->h;
+    if (src != oid_Broadcast)	// Index the link in the source object's slot
+	vector_push_back (&casycom_omap_slot(src)->outlinks, &dest);
+    OSlot* ol = casycom_omap_slot (dest);
+    if (!ol->links.size)	// The creator link determines the object type
+	ol->ifactory = casycom_find_factory (iid);
+    Proxy* e = vector_emplace_back (&ol->links);
+    e->interface = iid;
+    e->src = src;
+    e->dest = dest;
+    e->gen = ol->gen;
+    DEBUG_PRINTF ("[T] created proxy link %hu -> %hu.%s\n", e->src, e->dest, e->interface->name);
+    return *e;
 }
 
-static void casycom_destroy_link_at (size_t l)
+static void casycom_destroy_link_at (oid_t oid, size_t l)
 {
-    if (l >= _casycom_omap.size)
+    if (oid >= _casycom_ctx->omap.size || l >= _casycom_ctx->omap.d[oid].links.size)
 	return;
-    MsgLink ol = _casycom_omap.d[l];	// casycom_destroy_object may destroy other links, so l will be invalidated
-    vector_erase (&_casycom_omap, l);
-    DEBUG_PRINTF ("[T] destroyed proxy link %hu -> %hu.%s\n", ol.h.src, ol.h.dest, ol.h.interface->name);
-    if (ol.o)	// If this is the link that created the object, destroy the object
-	casycom_destroy_object (&ol);
+    OSlot* ol = &_casycom_ctx->omap.d[oid];
+    const Proxy h = ol->links.d[l];
+    vector_erase (&ol->links, l);
+    DEBUG_PRINTF ("[T] destroyed proxy link %hu -> %hu.%s\n", h.src, h.dest, h.interface->name);
+    if (h.src != oid_Broadcast && h.src < _casycom_ctx->omap.size) {
+	OidVector* outl = &_casycom_ctx->omap.d[h.src].outlinks;
+	for (size_t i = outl->size; i--;) {
+	    if (outl->d[i] == oid) {
+		vector_erase (outl, i);
+		break;
+	    }
+	}
+	ol = &_casycom_ctx->omap.d[oid];
+    }
+    if (l)
+	return;
+    // If this is the link that created the object, destroy the object
+    casycom_destroy_object (oid);	// casycom_destroy_object may destroy other links, so ol will be invalidated
+    ol = &_casycom_ctx->omap.d[oid];
+    if (ol->links.size)	// The next link becomes the creator link
+	ol->ifactory = casycom_find_factory (ol->links.d[0].interface);
+    else
+	casycom_free_oid (oid);
 }
 
 void casycom_destroy_proxy (Proxy* pp)
 {
-    casycom_destroy_link_at (casycom_link_for_proxy (pp));
+    casycom_destroy_link_at (pp->dest, casycom_link_for_proxy (pp));
     pp->interface = NULL;
     pp->src = 0;
     pp->dest = 0;
+    pp->gen = 0;
 }
 
-static size_t casycom_omap_lower_bound (oid_t oid)
+static OSlot* casycom_omap_slot (oid_t oid)
 {
-    size_t first = 0, last = _casycom_omap.size;
-    while (first < last) {
-	size_t mid = (first + last) / 2;
-	if (_casycom_omap.d[mid].h.dest < oid)
-	    first = mid + 1;
-	else
-	    last = mid;
+    assert (oid <= oid_Last && "object id out of range");
+    if (oid >= _casycom_ctx->omap.size) {
+	size_t osz = _casycom_ctx->omap.size;
+	vector_resize (&_casycom_ctx->omap, oid+1);
+	for (size_t i = osz; i < _casycom_ctx->omap.size; ++i) {
+	    VECTOR_MEMBER_INIT (ProxyVector, _casycom_ctx->omap.d[i].links);
+	    VECTOR_MEMBER_INIT (OidVector, _casycom_ctx->omap.d[i].outlinks);
+	}
     }
-    return first;
+    return &_casycom_ctx->omap.d[oid];
+}
+
+static oid_t casycom_allocate_oid (void)
+{
+    // Skip oids taken by casycom_create_proxy_to with an explicit dest
+    while (_casycom_ctx->next_oid < _casycom_ctx->omap.size && _casycom_ctx->omap.d[_casycom_ctx->next_oid].links.size)
+	++_casycom_ctx->next_oid;
+    while (_casycom_ctx->nfree && (_casycom_ctx->nfree > c_OidReuseDelay || _casycom_ctx->next_oid > oid_Last)) {
+	oid_t oid = _casycom_ctx->free_first;
+	OSlot* ol = &_casycom_ctx->omap.d[oid];
+	_casycom_ctx->free_first = ol->nextfree;
+	if (!--_casycom_ctx->nfree)
+	    _casycom_ctx->free_last = 0;
+	ol->nextfree = 0;
+	ol->flags &= ~(1<<f_Free);
+	if (!ol->links.size)	// also may have been taken with an explicit dest
+	    return oid;
+    }
+    assert (_casycom_ctx->next_oid <= oid_Last && "ran out of object ids");
+    return _casycom_ctx->next_oid++;
+}
+
+static void casycom_free_oid (oid_t oid)
+{
+    OSlot* ol = &_casycom_ctx->omap.d[oid];
+    assert (!ol->o && !ol->links.size && "only unused oids can be freed");
+    ol->ifactory = 0;
+    ol->flags &= (1<<f_Free);
+    ol->nqueued = 0;
+    ol->nposted = 0;
+    ++ol->gen;	// Invalidates remaining messages to the old object
+    if (oid < oid_First || (ol->flags & (1<<f_Free)))
+	return;
+    ol->flags |= (1<<f_Free);
+    if (_casycom_ctx->free_last)
+	_casycom_ctx->omap.d[_casycom_ctx->free_last].nextfree = oid;
+    else
+	_casycom_ctx->free_first = oid;
+    _casycom_ctx->free_last = oid;
+    ++_casycom_ctx->nfree;
 }
 
 static size_t casycom_link_for_proxy (const Proxy* ph)
 {
-    for (size_t l = casycom_omap_lower_bound (ph->dest);
-		l < _casycom_omap.size && _casycom_omap.d[l].h.dest == ph->dest;
-		++l)
-	if (_casycom_omap.d[l].h.src == ph->src)
+    const OSlot* ol = casycom_find_destination (ph->dest);
+    if (ol && ol->gen != ph->gen)
+	return SIZE_MAX;	// the proxy's object was destroyed and its oid reused
+    for (size_t l = 0; ol && l < ol->links.size; ++l)
+	if (ol->links.d[l].src == ph->src)
 	    return l;
     return SIZE_MAX;
 }
 
-static MsgLink* casycom_link_for_object (const void* o)
+#define casycom_object_of_oid(c,oid)	((const void*)(c)->omap.d[oid].o)
+#define casycom_pointer_hash(p)		hash_index_mix ((uintptr_t)(p))
+#define casycom_same_key(a,b)		((a) == (b))
+IMPLEMENT_HASH_INDEX (static, OIndex, oid_t, CasycomContext, const void*, casycom_object_of_oid, casycom_pointer_hash, casycom_same_key)
+
+static OSlot* casycom_link_for_object (const void* o)
 {
-    for (size_t dp = 0; dp < _casycom_omap.size; ++dp)
-	if (_casycom_omap.d[dp].o == o)
-	    return &_casycom_omap.d[dp];
-    return NULL;
+    size_t i = OIndex_find (_casycom_ctx, &_casycom_ctx->oindex, o);
+    return i == SIZE_MAX ? NULL : &_casycom_ctx->omap.d[_casycom_ctx->oindex.d[i]];
 }
 
-static MsgLink* casycom_find_destination (oid_t doid)
+static OSlot* casycom_find_destination (oid_t doid)
 {
-    size_t dp = casycom_omap_lower_bound (doid);
-    if (dp < _casycom_omap.size && _casycom_omap.d[dp].h.dest == doid)
-	return &_casycom_omap.d[dp];
+    if (doid < _casycom_ctx->omap.size && _casycom_ctx->omap.d[doid].links.size)
+	return &_casycom_ctx->omap.d[doid];
     return NULL;
 }
 
 void casycom_debug_dump_link_table (void)
 {
     DEBUG_PRINTF ("[D] Current link table:\n");
-    for (size_t i = 0; i < _casycom_omap.size; ++i) {
-	const MsgLink* UNUSED l = &_casycom_omap.d[i];
-	DEBUG_PRINTF ("\t%hu -> %hu.%s\t(%p),%x\n", l->h.src, l->h.dest, l->h.interface->name, l->o, l->flags);
+    for (size_t i = 0; i < _casycom_ctx->omap.size; ++i) {
+	const OSlot* UNUSED ol = &_casycom_ctx->omap.d[i];
+	for (size_t l = 0; l < ol->links.size; ++l) {
+	    const Proxy* UNUSED h = &ol->links.d[l];
+	    DEBUG_PRINTF ("\t%hu -> %hu.%s\t(%p),%x\n", h->src, h->dest, h->interface->name, l ? NULL : ol->o, ol->flags);
+	}
     }
 }
 
@@ -252,7 +474,7 @@ void casycom_debug_dump_link_table (void)
 #ifndef NDEBUG
 static void casycom_debug_check_object (const Factory* o, const char* it)
 {
-    assert (o->create && "registered object must have a constructor");
+    assert ((o->create || o->object_size) && "registered object must have a constructor or an object size");
     assert (o->dtable[0] && "an object must implement at least one interface");
     DEBUG_PRINTF ("[T] Registered %s", it);
     for (const DTable* const* oi = (const DTable* const*) o->dtable; *oi; ++oi) {
@@ -263,13 +485,99 @@ static void casycom_debug_check_object (const Factory* o, const char* it)
 }
 #endif
 
+#define casycom_iid_of_index(c,ii)	((c)->interfaces.d[ii].iid)
+IMPLEMENT_HASH_INDEX (static inline, IIndex, uint16_t, CasycomContext, iid_t, casycom_iid_of_index, casycom_pointer_hash, casycom_same_key)
+
+static uint16_t casycom_interface_index (iid_t iid)
+{
+    size_t i = IIndex_find (_casycom_ctx, &_casycom_ctx->iindex, iid);
+    return i == SIZE_MAX ? 0 : _casycom_ctx->iindex.d[i];
+}
+
+// FNV-1a string hash
+static inline size_t casycom_name_hash (const char* name)
+{
+    uint32_t h = 2166136261u;
+    for (const char* c = name; *c; ++c)
+	h = (h ^ (uint8_t) *c) * 16777619u;
+    return h;
+}
+
+#define casycom_name_of_index(c,ii)	((c)->interfaces.d[ii].iid->name)
+#define casycom_same_name(a,b)		(!strcmp ((a), (b)))
+IMPLEMENT_HASH_INDEX (static inline, NIndex, uint16_t, CasycomContext, const char*, casycom_name_of_index, casycom_name_hash, casycom_same_name)
+
+/// Returns the index of \p iid, assigning the next one if not yet registered
+static uint16_t casycom_register_interface (iid_t iid)
+{
+    uint16_t ii = casycom_interface_index (iid);
+    if (ii)
+	return ii;
+    if (!_casycom_ctx->interfaces.size)
+	vector_emplace_back (&_casycom_ctx->interfaces);	// index 0 is reserved
+    assert (_casycom_ctx->interfaces.size < UINT16_MAX && "too many registered interfaces");
+    ii = _casycom_ctx->interfaces.size;
+    InterfaceEntry* ie = vector_emplace_back (&_casycom_ctx->interfaces);
+    ie->iid = iid;
+    IIndex_insert (_casycom_ctx, &_casycom_ctx->iindex, ii);
+    NIndex_insert (_casycom_ctx, &_casycom_ctx->nindex, ii);
+    return ii;
+}
+
+/// Adds \p o to the object table, filling its dtable array
+static uint16_t casycom_register_factory (const Factory* o, bool is_default)
+{
+    if (!_casycom_ctx->object_table.size) {	// entry 0 is reserved
+	FactoryEntry* fe = vector_emplace_back (&_casycom_ctx->object_table);
+	VECTOR_MEMBER_INIT (DTableVector, fe->dtables);
+	VECTOR_MEMBER_INIT (SlabVector, fe->slabs);
+    }
+    uint16_t ifactory = 1;	// Registering the same factory again reuses its entry
+    while (ifactory < _casycom_ctx->object_table.size && _casycom_ctx->object_table.d[ifactory].factory != o)
+	++ifactory;
+    if (ifactory == _casycom_ctx->object_table.size) {
+	assert (ifactory < UINT16_MAX && "too many registered factories");
+	FactoryEntry* fe = vector_emplace_back (&_casycom_ctx->object_table);
+	fe->factory = o;
+	VECTOR_MEMBER_INIT (DTableVector, fe->dtables);
+	VECTOR_MEMBER_INIT (SlabVector, fe->slabs);
+    }
+    for (const DTable* const* oi = (const DTable* const*) o->dtable; *oi; ++oi) {
+	uint16_t ii = casycom_register_interface ((*oi)->interface);
+	DTableVector* dtables = &_casycom_ctx->object_table.d[ifactory].dtables;
+	if (ii >= dtables->size)
+	    vector_resize (dtables, ii+1);	// new entries are zeroed by vector_reserve
+	if (!dtables->d[ii])
+	    dtables->d[ii] = *oi;
+	// The default factory is only used when nothing else implements iid
+	if (!is_default && !_casycom_ctx->interfaces.d[ii].ifactory)
+	    _casycom_ctx->interfaces.d[ii].ifactory = ifactory;
+    }
+    return ifactory;
+}
+
 /// Registers an object class for creation
 void casycom_register (const Factory* o)
 {
     #ifndef NDEBUG
 	casycom_debug_check_object (o, "class");
     #endif
-    vector_push_back (&_casycom_object_table, &o);
+    casycom_register_factory (o, false);
+}
+
+/// Registers an object class whose objects are run on worker threads,
+/// when enabled with casycom_enable_workers. Message handlers of these
+/// objects may only send messages through existing proxies, and call
+/// casycom_error and casycom_mark_unused on their own object. Creating
+/// and destroying proxies must be done in init, create, or destroy, which
+/// are called on the loop thread, as are error and object_destroyed.
+void casycom_register_threaded (const Factory* o)
+{
+    #ifndef NDEBUG
+	casycom_debug_check_object (o, "threaded class");
+    #endif
+    uint16_t ifactory = casycom_register_factory (o, false);
+    _casycom_ctx->object_table.d[ifactory].threaded = true;
 }
 
 /// Registers object class for unknown interfaces
@@ -278,37 +586,96 @@ void casycom_register_default (const Factory* o)
     #ifndef NDEBUG
 	if (o)
 	    casycom_debug_check_object (o, "default class");
-	else if (_casycom_default_object)
+	else if (_casycom_ctx->default_object)
 	    DEBUG_PRINTF ("[T] Unregistered default class");
     #endif
-    _casycom_default_object = o;
+    _casycom_ctx->default_object = o;
+    _casycom_ctx->default_ifactory = o ? casycom_register_factory (o, true) : 0;
 }
 
 /// Finds object id of the given object
 oid_t casycom_oid_of_object (const void* o)
 {
-    MsgLink* ml = casycom_link_for_object (o);
-    return ml ? ml->h.dest : oid_Broadcast;
+    OSlot* ml = casycom_link_for_object (o);
+    return ml ? vector_p2i (&_casycom_ctx->omap, ml) : oid_Broadcast;
 }
 
 /// Marks the given object unused, to be deleted during the next idle
 void casycom_mark_unused (const void* o)
 {
-    MsgLink* ml = casycom_link_for_object (o);
-    if (ml)
-	ml->flags |= (1<<f_Unused);
+    Mailbox* mb = _casycom_worker_mailbox;
+    if (mb) {	// On a worker, the loop thread will mark it
+	assert (o == mb->o && "objects run on workers may only mark themselves unused");
+	acquire_lock (&mb->lock);
+	mb->unused = true;
+	release_lock (&mb->lock);
+	return;
+    }
+    OSlot* ml = casycom_link_for_object (o);
+    if (!ml || (ml->flags & (1<<f_Unused)))
+	return;
+    ml->flags |= (1<<f_Unused);
+    oid_t oid = vector_p2i (&_casycom_ctx->omap, ml);
+    vector_push_back (&_casycom_ctx->unused, &oid);
 }
 
-static void* casycom_create_link_object (MsgLink* ml, const Msg* msg)
+static void* casycom_create_link_object (OSlot* ml, const Msg* msg)
 {
     assert (!ml->o && "internal error: object already exists");
     // create using the otable
-    DEBUG_PRINTF ("[T] Creating object %hu.%s\n", ml->h.dest, casymsg_interface_name(msg));
-    void* o = ml->factory->create (msg);
+    DEBUG_PRINTF ("[T] Creating object %hu.%s\n", msg->h.dest, casymsg_interface_name(msg));
+    const Factory* f = casycom_slot_factory (ml);
+    void* o;
+    if (f->object_size) {
+	o = casycom_alloc_pooled_object (ml->ifactory);
+	if (f->init)
+	    f->init (o, msg);
+    } else
+	o = f->create (msg);
     assert (o && "object create method must return a valid object or die");
     return o;
 }
 
+// Pooled objects are aligned to cache lines, so that objects used by
+// different threads do not share them.
+enum {
+    c_ObjectAlignment = 64,
+    c_ObjectSlabSize = 16*1024,
+    c_ObjectSlabMinObjects = 8
+};
+
+static void* casycom_alloc_pooled_object (uint16_t ifactory)
+{
+    FactoryEntry* fe = &_casycom_ctx->object_table.d[ifactory];
+    if (!fe->free_objects) {	// Carve a new slab into free objects
+	const size_t osz = ceilg (fe->factory->object_size, c_ObjectAlignment);
+	size_t nobj = c_ObjectSlabSize / osz;
+	if (nobj < c_ObjectSlabMinObjects)
+	    nobj = c_ObjectSlabMinObjects;
+	char* slab = aligned_alloc (c_ObjectAlignment, nobj*osz);
+	if (!slab) {
+	    casycom_log (LOG_ERR, "out of memory\n");
+	    exit (EXIT_FAILURE);
+	}
+	vector_push_back (&fe->slabs, &slab);
+	for (size_t i = nobj; i--;) {
+	    *(void**)&slab[i*osz] = fe->free_objects;
+	    fe->free_objects = &slab[i*osz];
+	}
+    }
+    void* o = fe->free_objects;
+    fe->free_objects = *(void**) o;
+    memset (o, 0, fe->factory->object_size);
+    return o;
+}
+
+static void casycom_free_pooled_object (uint16_t ifactory, void* o)
+{
+    FactoryEntry* fe = &_casycom_ctx->object_table.d[ifactory];
+    *(void**) o = fe->free_objects;
+    fe->free_objects = o;
+}
+
 void* casycom_create_object (const iid_t iid)
 {
     Proxy op = casycom_create_proxy (iid, oid_Broadcast);
@@ -318,103 +685,133 @@ void* casycom_create_object (const iid_t iid)
     return o;
 }
 
-static void casycom_destroy_object (MsgLink* ol)
+static void casycom_destroy_object (oid_t oid)
 {
     // destroying an object can cause all kinds of ugly recursion as notified
     // objects destroy proxies and mess up OMap. To work around these problems
     // links must be saved and various locks set. ol->o is one of those locks.
-    if (!ol->o)
+    OSlot* ol = &_casycom_ctx->omap.d[oid];
+    void* o = ol->o;
+    if (!o)
 	return;
-    DEBUG_PRINTF ("[T] destroying object %hu.%s\n", ol->h.dest, ol->h.interface->name);
+    const Factory* f = casycom_slot_factory (ol);
+    const uint16_t ifactory = ol->ifactory;
+    DEBUG_PRINTF ("[T] destroying object %hu.%s\n", oid, ((const DTable*) f->dtable[0])->interface->name);
+    size_t oi = OIndex_find (_casycom_ctx, &_casycom_ctx->oindex, o);
+    if (oi != SIZE_MAX)
+	OIndex_erase (_casycom_ctx, &_casycom_ctx->oindex, oi);
+    ol->o = NULL;
+    ol->flags &= ~(1<<f_Unused);
+    if (ol->mailbox) {	// Waits for the worker to finish with the object
+	casycom_mailbox_destroy (ol->mailbox);
+	ol->mailbox = NULL;
+    }
     // Call the destructor, if set.
-    if (ol->factory->destroy) {
-	ol->factory->destroy (ol->o);
-	ol->o = NULL;
-    } else
-	xfree (ol->o);	// Otherwise just free
-    ol->flags = 0;
-    const oid_t oid = ol->h.dest;
-    // Notify callers of destruction
-    oid_t callers [16];
-    unsigned nCallers = 0;
+    if (f->destroy)
+	f->destroy (o);
+    if (f->object_size)
+	casycom_free_pooled_object (ifactory, o);	// Pooled objects are returned to the pool
+    else if (!f->destroy)
+	xfree (o);	// Otherwise just free
+    // Notify callers of destruction, found through the incoming links.
     // In two passes because object_destroyed handlers can modify OMap
-    for (size_t di = 0; di < _casycom_omap.size; ++di) {
-	const MsgLink* cl = &_casycom_omap.d[di];
-	if (cl->h.dest == oid && cl->h.src != oid_Broadcast)		// Object calls the destroyed object
-	    callers[nCallers++] = cl->h.src;
-    }
-    for (unsigned i = 0; i < nCallers; ++i) {
-	const MsgLink* cl = casycom_find_destination (callers[i]);	// Find the link with its pointer
-	if (cl && cl->factory->object_destroyed) {			// notify of destruction, if requested
-	    DEBUG_PRINTF ("[T]\tNotifying object %hu -> %hu.%s\n", cl->h.src, cl->h.dest, cl->h.interface->name);
-	    cl->factory->object_destroyed (cl->o, oid);
+    VECTOR (OidVector, callers);
+    ol = &_casycom_ctx->omap.d[oid];
+    vector_reserve (&callers, ol->links.size);
+    for (size_t l = 0; l < ol->links.size; ++l)
+	if (ol->links.d[l].src != oid_Broadcast)	// Object calls the destroyed object
+	    vector_push_back (&callers, &ol->links.d[l].src);
+    for (size_t i = 0; i < callers.size; ++i) {
+	const OSlot* cl = casycom_find_destination (callers.d[i]);	// Find the caller object
+	if (cl && cl->o && casycom_slot_factory(cl)->object_destroyed) {	// notify of destruction, if requested
+	    DEBUG_PRINTF ("[T]\tNotifying object %hu of %hu destruction\n", callers.d[i], oid);
+	    Mailbox* mb = cl->mailbox;
+	    if (mb)
+		casycom_mailbox_hold (mb);
+	    casycom_slot_factory(cl)->object_destroyed (cl->o, oid);
+	    if (mb)
+		casycom_mailbox_unhold (mb);
 	}
     }
-    // Erase all links from this object
-    for (size_t di = 0; di < _casycom_omap.size; ++di) {
-	if (_casycom_omap.d[di].h.src == oid) {
-	    casycom_destroy_link_at (di);
-	    di = SIZE_MAX;	// recursion will modify OMap, so have to start over
+    vector_deallocate (&callers);
+    // Erase all links from this object, newest first. Each destroyed
+    // link removes itself from outlinks, and recursion may remove others.
+    while (_casycom_ctx->omap.d[oid].outlinks.size) {
+	const OidVector* outl = &_casycom_ctx->omap.d[oid].outlinks;
+	oid_t di = outl->d[outl->size-1];
+	const OSlot* dl = &_casycom_ctx->omap.d[di];
+	size_t l = dl->links.size;
+	while (l-- && dl->links.d[l].src != oid) {}
+	if (l < dl->links.size)
+	    casycom_destroy_link_at (di, l);
+	else {
+	    assert (!"internal error: outgoing link index is out of sync");
+	    vector_pop_back (&_casycom_ctx->omap.d[oid].outlinks);
 	}
     }
 }
 
 static inline void casycom_destroy_unused_objects (void)
 {
-    for (size_t i = 0; i < _casycom_omap.size; ++i) {
-	if (_casycom_omap.d[i].flags & (1<<f_Unused)) {
-	    DEBUG_PRINTF ("[I] destroying unused object %hu.%s\n", _casycom_omap.d[i].h.dest, _casycom_omap.d[i].h.interface->name);
-	    casycom_destroy_object (&_casycom_omap.d[i]);
-	    i = SIZE_MAX;	// start over because casycom_destroy_object modifies OMap
+    // casycom_destroy_object may mark other objects unused, appending them
+    for (size_t i = 0; i < _casycom_ctx->unused.size; ++i) {
+	oid_t oid = _casycom_ctx->unused.d[i];
+	if (_casycom_ctx->omap.d[oid].flags & (1<<f_Unused)) {
+	    DEBUG_PRINTF ("[I] destroying unused object %hu\n", oid);
+	    casycom_destroy_object (oid);
 	}
     }
+    vector_clear (&_casycom_ctx->unused);
 }
 
-static const DTable* casycom_find_dtable (const Factory* o, iid_t iid)
+static inline const Factory* casycom_slot_factory (const OSlot* ol)
+    { return ol->ifactory ? _casycom_ctx->object_table.d[ol->ifactory].factory : NULL; }
+
+static const DTable* casycom_find_dtable (const OSlot* ol, iid_t iid)
 {
-    for (const DTable* const* oi = (const DTable* const*) o->dtable; *oi; ++oi)
-	if ((*oi)->interface == iid)
-	    return *oi;
-    if (o == _casycom_default_object)
-	return _casycom_default_object->dtable[0];
+    if (!ol->ifactory)
+	return NULL;
+    const FactoryEntry* fe = &_casycom_ctx->object_table.d[ol->ifactory];
+    uint16_t ii = casycom_interface_index (iid);
+    if (ii < fe->dtables.size && fe->dtables.d[ii])
+	return fe->dtables.d[ii];
+    if (ol->ifactory == _casycom_ctx->default_ifactory)
+	return fe->factory->dtable[0];
     return NULL;
 }
 
-static const Factory* casycom_find_factory (iid_t iid)
+static uint16_t casycom_find_factory (iid_t iid)
 {
-    for (size_t i = 0; i < _casycom_object_table.size; ++i) {
-	const Factory* ot = _casycom_object_table.d[i];
-	if (casycom_find_dtable (ot, iid))
-	    return ot;
-    }
-    return _casycom_default_object;
+    uint16_t ii = casycom_interface_index (iid);
+    if (ii && _casycom_ctx->interfaces.d[ii].ifactory)
+	return _casycom_ctx->interfaces.d[ii].ifactory;
+    return _casycom_ctx->default_ifactory;
 }
 
 iid_t casycom_interface_by_name (const char* iname)
 {
-    for (size_t i = 0; i < _casycom_object_table.size; ++i) {
-	const Factory* f = _casycom_object_table.d[i];
-	for (const DTable* const* di = (const DTable* const*) f->dtable; *di; ++di)
-	    if (!strcmp ((*di)->interface->name, iname))
-		return (*di)->interface;
-    }
-    if (_casycom_default_object) {
-        iid_t default_interface = ((const DTable*)_casycom_default_object->dtable[0])->interface;
-	if (!strcmp (default_interface->name, iname))
-	    return default_interface;
-    }
-    return NULL;
+    size_t i = NIndex_find (_casycom_ctx, &_casycom_ctx->nindex, iname);
+    return i == SIZE_MAX ? NULL : _casycom_ctx->interfaces.d[_casycom_ctx->nindex.d[i]].iid;
 }
 
-static MsgLink* casycom_find_or_create_destination (const Msg* msg)
+static OSlot* casycom_find_or_create_destination (const Msg* msg)
 {
-    MsgLink* ml;
+    OSlot* ml;
     // Object constructor may create proxies, modifying the link map,
     // so if a new object is created, need to find the link again.
     for (void* no = NULL;;) {
 	ml = casycom_find_destination (msg->h.dest);
-	if (!ml || ml->o || (ml->o = no))
+	if (!ml || ml->gen != msg->h.gen)
+	    return NULL;	// message addressed to object deleted after sending
+	if (ml->o)
 	    break;
+	if (no) {
+	    ml->o = no;
+	    OIndex_insert (_casycom_ctx, &_casycom_ctx->oindex, msg->h.dest);
+	    if (_casycom_ctx->workers.size && _casycom_ctx->object_table.d[ml->ifactory].threaded)
+		casycom_create_mailbox (ml);
+	    break;
+	}
 	no = casycom_create_link_object (ml, msg);	// create the object, if needed
     }
     return ml;
@@ -428,16 +825,17 @@ static MsgLink* casycom_find_or_create_destination (const Msg* msg)
 void casycom_queue_message (Msg* msg)
 {
     #ifndef NDEBUG	// Message validity checks
+    if (_casycom_loop_ctx == _casycom_ctx) {	// Other threads can not read the link map
 	assert (msg->h.interface && (!msg->size || msg->body) && "invalid message");
-	const Factory* dest_factory = casycom_find_factory (msg->h.interface);
+	const uint16_t dest_factory = casycom_find_factory (msg->h.interface);
 	if (!dest_factory)
 	    DEBUG_PRINTF ("Error: you must call casycom_register (&f_%s) to use this interface\n", casymsg_interface_name(msg));
 	assert (dest_factory && "message addressed to unregistered interface");
-	MsgLink* destl = casycom_find_destination (msg->h.dest);
+	OSlot* destl = casycom_find_destination (msg->h.dest);
 	assert (destl && "message addressed to an unknown destination");
-	const DTable* dtable = casycom_find_dtable (destl->factory, msg->h.interface);
+	const DTable* dtable = casycom_find_dtable (destl, msg->h.interface);
 	assert (dtable && "message forwarded to object that does not support its interface");
-	assert (casycom_link_for_proxy(&msg->h) < _casycom_omap.size && "message sent through a deleted proxy; do not delete proxies in the destructor or in ObjectDeleted!");
+	assert (casycom_link_for_proxy(&msg->h) != SIZE_MAX && "message sent through a deleted proxy; do not delete proxies in the destructor or in ObjectDeleted!");
 	if (msg->imethod != method_create_object) {
 	    assert (msg->imethod < casyiface_count_methods (msg->h.interface) && "invalid message destination method");
 	    size_t vmsgsize = casymsg_validate_signature (msg);
@@ -450,41 +848,118 @@ void casycom_queue_message (Msg* msg)
 	    assert ((msg->fdoffset == NO_FD_IN_MESSAGE || (msg->fdoffset+4u <= msg->size && ceilg(msg->fdoffset,4) == msg->fdoffset)) && "you must use casymsg_write_fd to write a file descriptor to a message");
 	} else
 	    assert (!msg->size && msg->fdoffset == NO_FD_IN_MESSAGE && "invalid createObject message");
+    }
     #endif
-    acquire_lock (&_casycom_output_queue_lock);
-    vector_push_back (&_casycom_output_queue, &msg);
-    release_lock (&_casycom_output_queue_lock);
+    if (_casycom_loop_ctx == _casycom_ctx) {
+	// The factory route hook may take the message, unless earlier
+	// messages to the object are queued and must be delivered first.
+	const OSlot* ml = casycom_find_destination (msg->h.dest);
+	if (ml && ml->o && !ml->nqueued && !ml->mailbox && ml->gen == msg->h.gen) {
+	    const Factory* f = casycom_slot_factory (ml);
+	    if (f && f->route && f->route (ml->o, msg))
+		return;
+	}
+	casycom_count_queued (msg);
+	vector_push_back (&_casycom_ctx->output_queue, &msg);
+    } else
+	casycom_queue_foreign_message (msg);
+}
+
+// Only messages to the current generation of the oid are counted;
+// those to a freed object are dropped when delivered.
+static inline void casycom_count_queued (const Msg* msg)
+{
+    OSlot* ml = msg->h.dest < _casycom_ctx->omap.size ? &_casycom_ctx->omap.d[msg->h.dest] : NULL;
+    if (ml && ml->gen == msg->h.gen) {
+	++ml->nqueued;
+	++ml->nposted;
+    }
+}
+
+static inline void casycom_count_delivered (const Msg* msg)
+{
+    OSlot* ml = msg->h.dest < _casycom_ctx->omap.size ? &_casycom_ctx->omap.d[msg->h.dest] : NULL;
+    if (ml && ml->gen == msg->h.gen && ml->nqueued)
+	--ml->nqueued;
+}
+
+static void casycom_queue_foreign_message (Msg* msg)
+{
+    Msg* head = atomic_load (&_casycom_ctx->foreign_queue);
+    do
+	msg->next = head;
+    while (!atomic_compare_exchange_weak (&_casycom_ctx->foreign_queue, &head, msg));
+    if (!head)	// Wake up the loop, which takes all messages at once
+	casycom_wake_loop();
+}
+
+static void casycom_take_foreign_messages (void)
+{
+    if (!atomic_load (&_casycom_ctx->foreign_queue))
+	return;
+    Msg* head = atomic_exchange (&_casycom_ctx->foreign_queue, NULL);
+    // The stack is in reverse order of queueing
+    size_t first = _casycom_ctx->output_queue.size;
+    for (Msg* m = head; m; m = m->next) {
+	casycom_count_queued (m);
+	vector_push_back (&_casycom_ctx->output_queue, &m);
+    }
+    for (size_t i = first, j = _casycom_ctx->output_queue.size; i+1 < j; ++i, --j) {
+	Msg* t = _casycom_ctx->output_queue.d[i];
+	_casycom_ctx->output_queue.d[i] = _casycom_ctx->output_queue.d[j-1];
+	_casycom_ctx->output_queue.d[j-1] = t;
+    }
+}
+
+static inline bool casycom_have_messages (void)
+{
+    return _casycom_ctx->input_queue.size || _casycom_ctx->output_queue.size || atomic_load (&_casycom_ctx->foreign_queue) || atomic_load (&_casycom_ctx->worker_results);
 }
 
 static void casycom_do_message_queues (void)
 {
+    if (_casycom_ctx->msg_arena)
+	casymsg_arena_select (_casycom_ctx->pass % 2);
     // Deliver all messages in the input queue
-    for (size_t m = 0; m < _casycom_input_queue.size; ++m) {
-	const Msg* msg = _casycom_input_queue.d[m];
+    for (size_t m = 0; m < _casycom_ctx->input_queue.size; ++m) {
+	const Msg* msg = _casycom_ctx->input_queue.d[m];
 	if (DEBUG_MSG_TRACE)
 	    casycom_debug_message_dump (msg);
-	MsgLink* ml = casycom_find_or_create_destination (msg);
+	casycom_count_delivered (msg);
+	OSlot* ml = casycom_find_or_create_destination (msg);
 	if (!ml)	// message addressed to object deleted after sending
 	    continue;
 	// Call the interface dispatch with the object and the message
-	const DTable* dtable = casycom_find_dtable (ml->factory, msg->h.interface);
+	const DTable* dtable = casycom_find_dtable (ml, msg->h.interface);
+	if (ml->mailbox) {	// ... or have a worker call it
+	    casycom_post_to_mailbox (ml->mailbox, dtable, casymsg_promote (_casycom_ctx->input_queue.d[m]));
+	    _casycom_ctx->input_queue.d[m] = NULL;
+	    continue;
+	}
 	((pfn_dispatch) dtable->interface->dispatch) (dtable, ml->o, msg);
 	// After each message, check for generated errors
-	if (_casycom_error && !casycom_forward_error (msg->h.dest, msg->h.dest)) {
+	if (_casycom_ctx->error && !casycom_forward_error (msg->h.dest, msg->h.dest)) {
 	    // If nobody can handle the error, print it and quit
-	    casycom_log (LOG_ERR, "Error: %s\n", _casycom_error);
+	    casycom_log (LOG_ERR, "Error: %s\n", _casycom_ctx->error);
 	    casycom_quit (EXIT_FAILURE);
+	    while (++m < _casycom_ctx->input_queue.size)	// the rest are dropped
+		casycom_count_delivered (_casycom_ctx->input_queue.d[m]);
 	    break;
 	}
     }
     // Clear input queue
-    for (size_t m = 0; m < _casycom_input_queue.size; ++m)
-	casymsg_free (_casycom_input_queue.d[m]);
-    vector_clear (&_casycom_input_queue);
+    for (size_t m = 0; m < _casycom_ctx->input_queue.size; ++m)
+	casymsg_free (_casycom_ctx->input_queue.d[m]);
+    vector_clear (&_casycom_ctx->input_queue);
+    if (_casycom_ctx->msg_arena) {
+	casymsg_arena_select (-1);
+	// The messages created during the previous pass have now been freed
+	casymsg_arena_reset (++_casycom_ctx->pass % 2);
+    }
     // And make the output queue the input queue for the next round
-    acquire_lock (&_casycom_output_queue_lock);
-    vector_swap (&_casycom_input_queue, &_casycom_output_queue);
-    release_lock (&_casycom_output_queue_lock);
+    casycom_take_worker_results();
+    casycom_take_foreign_messages();
+    vector_swap (&_casycom_ctx->input_queue, &_casycom_ctx->output_queue);
 }
 
 void casycom_debug_message_dump (const Msg* msg)
@@ -497,6 +972,310 @@ void casycom_debug_message_dump (const Msg* msg)
     hexdump (msg->body, msg->size);
 }
 
+//}}}-------------------------------------------------------------------
+//{{{ Worker threads
+
+static void casycom_wake_loop (void)
+{
+    uint64_t one = 1;
+    if (_casycom_ctx->wakeup_fd >= 0 && 0 > write (_casycom_ctx->wakeup_fd, &one, sizeof(one)))
+	casycom_log (LOG_ERR, "failed to wake up the main loop: %s\n", strerror(errno));
+}
+
+static void casycom_create_mailbox (OSlot* ml)
+{
+    Mailbox* mb = xalloc (sizeof(Mailbox));
+    mb->o = ml->o;
+    mb->oid = vector_p2i (&_casycom_ctx->omap, ml);
+    VECTOR_MEMBER_INIT (MailboxQueue, mb->msgs);
+    const OSlot* cl = casycom_find_destination (ml->links.d[0].src);
+    pthread_mutex_lock (&_casycom_ctx->workers_lock);
+    if (cl && cl->mailbox) {	// Created by a threaded object; both stay on its worker
+	mb->worker = cl->mailbox->worker;
+	mb->pinned = cl->mailbox->pinned = true;
+    } else
+	mb->worker = _casycom_ctx->next_worker++ % _casycom_ctx->workers.size;
+    pthread_mutex_unlock (&_casycom_ctx->workers_lock);
+    ml->mailbox = mb;
+}
+
+static void casycom_mailbox_free (Mailbox* mb)
+{
+    vector_deallocate (&mb->msgs);
+    xfree (mb->error);
+    xfree (mb);
+}
+
+// These two are called with mb->lock held
+static inline bool casycom_mailbox_runnable (const Mailbox* mb)
+    { return !mb->queued && !mb->holds && !mb->dead && !mb->error && mb->msgs.size; }
+static inline bool casycom_mailbox_releasable (const Mailbox* mb)
+    { return mb->dead && !mb->queued && !mb->reported && !mb->holds; }
+
+static void casycom_schedule_mailbox (Mailbox* mb)
+{
+    pthread_mutex_lock (&_casycom_ctx->workers_lock);
+    vector_push_back (&_casycom_ctx->workers.d[mb->worker].runq, &mb);
+    pthread_cond_broadcast (&_casycom_ctx->workers_cond);
+    pthread_mutex_unlock (&_casycom_ctx->workers_lock);
+}
+
+static void casycom_post_to_mailbox (Mailbox* mb, const DTable* dtable, Msg* msg)
+{
+    atomic_fetch_add (&_casycom_ctx->worker_pending, 1);
+    acquire_lock (&mb->lock);
+    MailboxEntry* e = vector_emplace_back (&mb->msgs);
+    e->msg = msg;
+    e->dtable = dtable;
+    const bool schedule = casycom_mailbox_runnable (mb);
+    mb->queued |= schedule;
+    release_lock (&mb->lock);
+    if (schedule)
+	casycom_schedule_mailbox (mb);
+}
+
+/// Keeps workers from running \p mb, waiting for the running batch to finish
+static void casycom_mailbox_hold (Mailbox* mb)
+{
+    acquire_lock (&mb->lock);
+    ++mb->holds;
+    while (mb->running) {
+	release_lock (&mb->lock);
+	tight_loop_pause();
+	acquire_lock (&mb->lock);
+    }
+    release_lock (&mb->lock);
+}
+
+static void casycom_mailbox_unhold (Mailbox* mb)
+{
+    acquire_lock (&mb->lock);
+    --mb->holds;
+    const bool schedule = casycom_mailbox_runnable (mb);
+    mb->queued |= schedule;
+    const bool release = casycom_mailbox_releasable (mb);
+    release_lock (&mb->lock);
+    if (schedule)
+	casycom_schedule_mailbox (mb);
+    else if (release)
+	casycom_mailbox_free (mb);
+}
+
+static void casycom_worker_done (size_t n)
+{
+    if (n && n == atomic_fetch_sub (&_casycom_ctx->worker_pending, n))
+	casycom_wake_loop();	// The loop may be waiting for the workers to finish
+}
+
+/// Counts work started on another thread, which will send its result
+/// to the current context. The loop will not quit until it is done.
+void casycom_async_begin (void)
+{
+    atomic_fetch_add (&_casycom_ctx->worker_pending, 1);
+}
+
+/// Called by the other thread, with the same current context, after sending the result
+void casycom_async_end (void)
+{
+    CasycomContext* ctx = _casycom_ctx;
+    pthread_mutex_lock (&ctx->workers_lock);
+    casycom_worker_done (1);
+    pthread_cond_broadcast (&ctx->async_cond);
+    pthread_mutex_unlock (&ctx->workers_lock);
+}
+
+// Called by casycom_destroy_object; undelivered messages are discarded
+static void casycom_mailbox_destroy (Mailbox* mb)
+{
+    casycom_mailbox_hold (mb);
+    acquire_lock (&mb->lock);
+    mb->dead = true;
+    const size_t ndiscarded = mb->msgs.size;
+    for (size_t i = 0; i < mb->msgs.size; ++i)
+	casymsg_free (mb->msgs.d[i].msg);
+    vector_clear (&mb->msgs);
+    release_lock (&mb->lock);
+    casycom_worker_done (ndiscarded);
+    casycom_mailbox_unhold (mb);
+}
+
+// Called on the worker with mb->lock held
+static void casycom_report_to_loop (Mailbox* mb)
+{
+    mb->reported = true;
+    Mailbox* head = atomic_load (&_casycom_ctx->worker_results);
+    do
+	mb->next = head;
+    while (!atomic_compare_exchange_weak (&_casycom_ctx->worker_results, &head, mb));
+    if (!head)
+	casycom_wake_loop();
+}
+
+static void casycom_take_worker_results (void)
+{
+    if (!atomic_load (&_casycom_ctx->worker_results))
+	return;
+    for (Mailbox *mb = atomic_exchange (&_casycom_ctx->worker_results, NULL), *next; mb; mb = next) {
+	acquire_lock (&mb->lock);
+	next = mb->next;
+	mb->reported = false;
+	const bool unused = mb->unused;
+	mb->unused = false;
+	char* e = mb->error;
+	mb->error = NULL;
+	++mb->holds;	// Keeps mb from being freed or rerun before the error is handled
+	release_lock (&mb->lock);
+	if (!mb->dead) {
+	    if (unused)
+		casycom_mark_unused (mb->o);
+	    if (e) {	// Handled as if the error was set by a message delivered here
+		casycom_error ("%s", e);
+		if (!casycom_forward_error (mb->oid, mb->oid)) {
+		    casycom_log (LOG_ERR, "Error: %s\n", _casycom_ctx->error);
+		    casycom_quit (EXIT_FAILURE);
+		}
+	    }
+	}
+	xfree (e);
+	casycom_mailbox_unhold (mb);
+    }
+}
+
+// Called with _casycom_ctx->workers_lock held
+static Mailbox* casycom_worker_take (size_t w)
+{
+    MailboxVector* q = &_casycom_ctx->workers.d[w].runq;
+    if (q->size) {
+	Mailbox* mb = q->d[0];
+	vector_erase (q, 0);
+	return mb;
+    }
+    // When idle, take an unpinned object from another worker
+    for (size_t i = 1; i < _casycom_ctx->workers.size; ++i) {
+	q = &_casycom_ctx->workers.d[(w+i) % _casycom_ctx->workers.size].runq;
+	for (size_t j = 0; j < q->size; ++j) {
+	    Mailbox* mb = q->d[j];
+	    if (!mb->pinned) {
+		vector_erase (q, j);
+		mb->worker = w;
+		return mb;
+	    }
+	}
+    }
+    return NULL;
+}
+
+// Delivers messages in mb until it is empty or held by the loop thread
+static void casycom_worker_run (Mailbox* mb)
+{
+    _casycom_worker_mailbox = mb;
+    VECTOR (MailboxQueue, batch);
+    acquire_lock (&mb->lock);
+    while (!mb->holds && !mb->dead && !mb->error && mb->msgs.size) {
+	vector_swap (&batch, &mb->msgs);
+	mb->running = true;
+	release_lock (&mb->lock);
+	for (size_t i = 0; i < batch.size; ++i) {
+	    const DTable* dtable = batch.d[i].dtable;
+	    ((pfn_dispatch) dtable->interface->dispatch) (dtable, mb->o, batch.d[i].msg);
+	    casymsg_free (batch.d[i].msg);
+	}
+	acquire_lock (&mb->lock);
+	mb->running = false;
+	if ((mb->unused || mb->error) && !mb->reported)
+	    casycom_report_to_loop (mb);
+	casycom_worker_done (batch.size);	// After the report, so the loop does not quit before it
+	vector_clear (&batch);
+    }
+    mb->queued = false;
+    const bool release = casycom_mailbox_releasable (mb);
+    release_lock (&mb->lock);
+    vector_deallocate (&batch);
+    _casycom_worker_mailbox = NULL;
+    if (release)
+	casycom_mailbox_free (mb);
+}
+
+static void* casycom_worker_main (void* vw)
+{
+    const Worker* worker = vw;
+    _casycom_ctx = worker->ctx;	// Messages sent on the worker go to its loop
+    const size_t w = worker - _casycom_ctx->workers.d;
+    pthread_mutex_lock (&_casycom_ctx->workers_lock);
+    while (!_casycom_ctx->workers_stop) {
+	Mailbox* mb = casycom_worker_take (w);
+	if (!mb) {
+	    pthread_cond_wait (&_casycom_ctx->workers_cond, &_casycom_ctx->workers_lock);
+	    continue;
+	}
+	pthread_mutex_unlock (&_casycom_ctx->workers_lock);
+	casycom_worker_run (mb);
+	pthread_mutex_lock (&_casycom_ctx->workers_lock);
+    }
+    pthread_mutex_unlock (&_casycom_ctx->workers_lock);
+    casymsg_pool_free();
+    return NULL;
+}
+
+/// Runs objects of classes registered with casycom_register_threaded on \p n worker threads
+void casycom_enable_workers (unsigned n)
+{
+    assert (!_casycom_ctx->workers.size && "workers are already running");
+    assert (n && n < UINT16_MAX && "invalid number of workers");
+    if (_casycom_ctx->workers.size || !n)
+	return;
+    vector_resize (&_casycom_ctx->workers, n);
+    for (unsigned i = 0; i < n; ++i) {
+	VECTOR_MEMBER_INIT (MailboxVector, _casycom_ctx->workers.d[i].runq);
+	_casycom_ctx->workers.d[i].ctx = _casycom_ctx;
+    }
+    _casycom_ctx->workers_stop = false;
+    for (unsigned i = 0; i < n; ++i) {
+	int r = pthread_create (&_casycom_ctx->workers.d[i].thread, NULL, casycom_worker_main, &_casycom_ctx->workers.d[i]);
+	if (r) {
+	    casycom_log (LOG_ERR, "failed to create worker thread: %s\n", strerror(r));
+	    exit (EXIT_FAILURE);
+	}
+    }
+}
+
+// Called by casycom_reset after all objects are destroyed
+static void casycom_stop_workers (void)
+{
+    if (!_casycom_ctx->workers.size)
+	return;
+    pthread_mutex_lock (&_casycom_ctx->workers_lock);
+    _casycom_ctx->workers_stop = true;
+    pthread_cond_broadcast (&_casycom_ctx->workers_cond);
+    pthread_mutex_unlock (&_casycom_ctx->workers_lock);
+    for (size_t i = 0; i < _casycom_ctx->workers.size; ++i)
+	pthread_join (_casycom_ctx->workers.d[i].thread, NULL);
+    // Only mailboxes of destroyed objects can remain queued
+    for (size_t i = 0; i < _casycom_ctx->workers.size; ++i) {
+	MailboxVector* q = &_casycom_ctx->workers.d[i].runq;
+	for (size_t j = 0; j < q->size; ++j) {
+	    Mailbox* mb = q->d[j];
+	    mb->queued = false;
+	    if (casycom_mailbox_releasable (mb))
+		casycom_mailbox_free (mb);
+	}
+	vector_deallocate (q);
+    }
+    casycom_take_worker_results();
+    vector_deallocate (&_casycom_ctx->workers);
+    _casycom_ctx->next_worker = 0;
+}
+
+// When all objects with work to do are running on workers, the loop
+// thread sleeps until they send messages, report, or finish.
+static void casycom_wait_for_workers (void)
+{
+    struct pollfd fd = { .fd = _casycom_ctx->wakeup_fd, .events = POLLIN };
+    uint64_t n;
+    if (0 < poll (&fd, 1, -1) && 0 > read (_casycom_ctx->wakeup_fd, &n, sizeof(n)))
+	DEBUG_PRINTF ("[T]\tWakeup fd read failed: %s\n", strerror(errno));
+}
+
 //}}}-------------------------------------------------------------------
 //--- Main API
 
@@ -504,67 +1283,187 @@ void casycom_debug_message_dump (const Msg* msg)
 void casycom_init (void)
 {
     DEBUG_PRINTF ("[I] initializing casycom\n");
-    atexit (casycom_reset);
+    if (_casycom_ctx == &_casycom_main_context)	// Other contexts are freed by their creators
+	atexit (casycom_reset);
     int syslogopt = 0, syslogfac = LOG_USER;
     if (isatty (STDIN_FILENO))
 	syslogopt = LOG_PERROR;
     else
 	syslogfac = LOG_DAEMON;
     openlog (NULL, syslogopt, syslogfac);
+    _casycom_loop_ctx = _casycom_ctx;
+    if (_casycom_ctx->wakeup_fd < 0)
+	_casycom_ctx->wakeup_fd = eventfd (0, EFD_NONBLOCK| EFD_CLOEXEC);
 }
 
 /// Resets the framework to its initial state
 void casycom_reset (void)
 {
     DEBUG_PRINTF ("[I] Resetting casycom\n");
-    while (_casycom_omap.size)
-	casycom_destroy_link_at (_casycom_omap.size-1);
-    vector_deallocate (&_casycom_omap);
-    acquire_lock (&_casycom_output_queue_lock);
-    for (size_t m = 0; m < _casycom_output_queue.size; ++m)
-	casymsg_free (_casycom_output_queue.d[m]);
-    vector_deallocate (&_casycom_output_queue);
-    release_lock (&_casycom_output_queue_lock);
-    for (size_t m = 0; m < _casycom_input_queue.size; ++m)
-	casymsg_free (_casycom_input_queue.d[m]);
-    vector_deallocate (&_casycom_input_queue);
-    vector_deallocate (&_casycom_object_table);
-    xfree (_casycom_error);
+    // Destructors may create new links, so repeat until none are left
+    for (bool haveLinks = true; haveLinks;) {
+	haveLinks = false;
+	for (size_t i = _casycom_ctx->omap.size; i--;) {
+	    while (_casycom_ctx->omap.d[i].links.size) {
+		haveLinks = true;
+		casycom_destroy_link_at (i, _casycom_ctx->omap.d[i].links.size-1);
+	    }
+	}
+    }
+    casycom_stop_workers();
+    // Other threads may still be working, and will send results here
+    pthread_mutex_lock (&_casycom_ctx->workers_lock);
+    while (atomic_load (&_casycom_ctx->worker_pending))
+	pthread_cond_wait (&_casycom_ctx->async_cond, &_casycom_ctx->workers_lock);
+    pthread_mutex_unlock (&_casycom_ctx->workers_lock);
+    for (size_t i = 0; i < _casycom_ctx->omap.size; ++i) {
+	vector_deallocate (&_casycom_ctx->omap.d[i].links);
+	vector_deallocate (&_casycom_ctx->omap.d[i].outlinks);
+    }
+    vector_deallocate (&_casycom_ctx->omap);
+    vector_deallocate (&_casycom_ctx->unused);
+    OIndex_deallocate (&_casycom_ctx->oindex);
+    _casycom_ctx->free_first = _casycom_ctx->free_last = 0;
+    _casycom_ctx->nfree = 0;
+    _casycom_ctx->next_oid = oid_First;
+    casycom_take_foreign_messages();
+    for (size_t m = 0; m < _casycom_ctx->output_queue.size; ++m)
+	casymsg_free (_casycom_ctx->output_queue.d[m]);
+    vector_deallocate (&_casycom_ctx->output_queue);
+    for (size_t m = 0; m < _casycom_ctx->input_queue.size; ++m)
+	casymsg_free (_casycom_ctx->input_queue.d[m]);
+    vector_deallocate (&_casycom_ctx->input_queue);
+    casymsg_arena_free();
+    casymsg_pool_free();
+    _casycom_ctx->msg_arena = false;
+    for (size_t i = 0; i < _casycom_ctx->object_table.size; ++i) {
+	FactoryEntry* fe = &_casycom_ctx->object_table.d[i];
+	vector_deallocate (&fe->dtables);
+	for (size_t j = 0; j < fe->slabs.size; ++j)
+	    free (fe->slabs.d[j]);
+	vector_deallocate (&fe->slabs);
+    }
+    vector_deallocate (&_casycom_ctx->object_table);
+    vector_deallocate (&_casycom_ctx->interfaces);
+    IIndex_deallocate (&_casycom_ctx->iindex);
+    NIndex_deallocate (&_casycom_ctx->nindex);
+    _casycom_ctx->default_object = NULL;
+    _casycom_ctx->default_ifactory = 0;
+    xfree (_casycom_ctx->error);
+    Timer_state_reset();
+    if (_casycom_ctx->wakeup_fd >= 0) {
+	close (_casycom_ctx->wakeup_fd);
+	_casycom_ctx->wakeup_fd = -1;
+    }
     DEBUG_PRINTF ("[I] Reset complete\n");
 }
 
+/// Allocates messages created during message delivery from per-pass arenas.
+/// Objects that keep messages past the next loop iteration must then call
+/// casymsg_promote on them.
+void casycom_enable_msg_arena (void)
+{
+    _casycom_ctx->msg_arena = true;
+}
+
+/// Creates a context for an independent message loop. Make it current
+/// with casycom_set_context on the thread that will run the loop, and
+/// call casycom_init there.
+CasycomContext* casycom_context_create (void)
+{
+    static const CasycomContext c_ContextInit = CASYCOM_CONTEXT_INIT;
+    CasycomContext* ctx = xalloc (sizeof(CasycomContext));
+    memcpy (ctx, &c_ContextInit, sizeof(*ctx));
+    return ctx;
+}
+
+/// Resets and frees \p ctx. Call it on the thread that ran its loop,
+/// after the loop exits; it must not be current on any other thread.
+void casycom_context_free (CasycomContext* ctx)
+{
+    if (!ctx)
+	return;
+    assert (ctx != &_casycom_main_context && "the main context can not be freed");
+    CasycomContext* octx = _casycom_ctx;
+    _casycom_ctx = ctx;
+    casycom_reset();
+    _casycom_ctx = (octx == ctx ? &_casycom_main_context : octx);
+    if (_casycom_loop_ctx == ctx)
+	_casycom_loop_ctx = NULL;
+    if (_casycom_signal_ctx == ctx)
+	_casycom_signal_ctx = NULL;
+    pthread_mutex_destroy (&ctx->workers_lock);
+    pthread_cond_destroy (&ctx->workers_cond);
+    pthread_cond_destroy (&ctx->async_cond);
+    xfree (ctx);
+}
+
+/// Makes \p ctx current on the calling thread; NULL selects the main context
+void casycom_set_context (CasycomContext* ctx)
+{
+    assert (!_casycom_worker_mailbox && "worker threads can not change context");
+    _casycom_ctx = ctx ? ctx : &_casycom_main_context;
+}
+
+/// Returns the current context of the calling thread
+CasycomContext* casycom_context (void)
+    { return _casycom_ctx; }
+
+void** casycom_context_slot (enum ECasycomContextSlot s)
+{
+    assert (s < CASYCOM_CONTEXT_SLOTS && "invalid context slot");
+    return &_casycom_ctx->slots[s];
+}
+
+int casycom_wakeup_fd (void)
+    { return _casycom_ctx->wakeup_fd; }
+
+/// Returns the number of messages ever queued to oid. They are delivered
+/// in order, so the nth is delivered when casycom_delivered_messages is n.
+uint32_t casycom_queued_messages (oid_t oid)
+    { return oid < _casycom_ctx->omap.size ? _casycom_ctx->omap.d[oid].nposted : 0; }
+
+/// Returns the number of messages ever delivered to oid
+uint32_t casycom_delivered_messages (oid_t oid)
+{
+    if (oid >= _casycom_ctx->omap.size)
+	return 0;
+    return _casycom_ctx->omap.d[oid].nposted - _casycom_ctx->omap.d[oid].nqueued;
+}
+
 /// Replaces casycom_init if casycom is the top-level framework in your process
 void casycom_framework_init (const Factory* oapp, argc_t argc, argv_t argv)
 {
     casycom_install_signal_handlers();
+    _casycom_signal_ctx = _casycom_ctx;
     casycom_init();
     casycom_register (oapp);
-    _casycom_appp = casycom_create_proxy_to (&i_App, oid_Broadcast, oid_App);
-    PApp_init (&_casycom_appp, argc, argv);
+    _casycom_ctx->appp = casycom_create_proxy_to (&i_App, oid_Broadcast, oid_App);
+    PApp_init (&_casycom_ctx->appp, argc, argv);
 }
 
 /// Sets the quit flag, causing the event loop to quit once all queued events are processed
 void casycom_quit (int exitCode)
 {
     DEBUG_PRINTF ("[T] Quit requested, exit code %d\n", exitCode);
-    _casycom_exit_code = exitCode;
-    _casycom_quitting = true;
+    _casycom_ctx->exit_code = exitCode;
+    _casycom_ctx->quitting = true;
 }
 
 /// Returns the current exit code
 int casycom_exit_code (void)
-    { return _casycom_exit_code; }
+    { return _casycom_ctx->exit_code; }
 bool casycom_is_quitting (void)
-    { return _casycom_quitting; }
+    { return _casycom_ctx->quitting; }
 bool casycom_is_failed (void)
-    { return _casycom_error != NULL; }
+    { return _casycom_ctx->error != NULL; }
 
 /// The main event loop. Returns exit code.
 int casycom_main (void)
 {
-    for (_casycom_quitting = false; !_casycom_quitting; casycom_idle())
+    for (_casycom_ctx->quitting = false; !_casycom_ctx->quitting; casycom_idle())
 	casycom_do_message_queues();
-    return _casycom_exit_code;
+    return _casycom_ctx->exit_code;
 }
 
 static void casycom_idle (void)
@@ -574,11 +1473,15 @@ static void casycom_idle (void)
     casycom_destroy_unused_objects();	// destroy objects marked unused
     // Process timers and fd waits
     int waittime = -1;
-    if (_casycom_input_queue.size + _casycom_output_queue.size + _casycom_quitting)
+    if (casycom_have_messages() || _casycom_ctx->quitting)
 	waittime = 0;	// Do not wait if there are packets in the queue
     bool haveTimers = Timer_run_timer (waittime);
+    // Timer_run_timer does not wait without timers; workers may still be busy
+    const bool workersBusy = atomic_load (&_casycom_ctx->worker_pending);
+    if (!haveTimers && workersBusy && waittime && !casycom_have_messages())
+	casycom_wait_for_workers();
     // Quit when there are no more packets or timers
-    if (!haveTimers && !(_casycom_input_queue.size + _casycom_output_queue.size)) {
+    if (!haveTimers && !casycom_have_messages() && !atomic_load (&_casycom_ctx->worker_pending)) {
 	DEBUG_PRINTF ("[E] Ran out of messages. Quitting.\n");
 	casycom_quit (EXIT_SUCCESS);
     }
@@ -591,7 +1494,7 @@ bool casycom_loop_once (void)
     Timer_run_timer (0);		// Check watched fds
     casycom_do_message_queues();	// Process any resulting messages
     casycom_destroy_unused_objects();	// Destroy objects marked unused
-    return _casycom_input_queue.size+_casycom_output_queue.size;
+    return casycom_have_messages() || atomic_load (&_casycom_ctx->worker_pending);
 }
 
 /// Create error to be handled at next casycom_forward_error call
@@ -604,17 +1507,26 @@ void casycom_error (const char* fmt, ...)
     if (0 > vasprintf (&e, fmt, args))
 	e = strdup ("unknown error");
     va_end (args);
-    if (!_casycom_error)	// First error message; move
-	_casycom_error = e;
+    // On a worker, the error is set in the mailbox, for the loop thread
+    Mailbox* mb = _casycom_worker_mailbox;
+    char** perr = &_casycom_ctx->error;
+    if (mb) {
+	acquire_lock (&mb->lock);
+	perr = &mb->error;
+    }
+    if (!*perr)	// First error message; move
+	*perr = e;
     else {
 	char* ne = NULL;	// Subsequent messages are appended
-	if (0 <= asprintf (&ne, "%s\n\t%s", _casycom_error, e)) {
-	    xfree (_casycom_error);
-	    _casycom_error = ne;
+	if (0 <= asprintf (&ne, "%s\n\t%s", *perr, e)) {
+	    xfree (*perr);
+	    *perr = ne;
 	    xfree (e);
 	}
     }
-    DEBUG_PRINTF ("[E] Error set: %s\n", _casycom_error);
+    DEBUG_PRINTF ("[E] Error set: %s\n", *perr);
+    if (mb)
+	release_lock (&mb->lock);
 }
 
 /// Forward error to object \p oid, indicating \e eoid as the failed object.
@@ -627,18 +1539,27 @@ void casycom_error (const char* fmt, ...)
 /// errors not on the create chain.
 bool casycom_forward_error (oid_t oid, oid_t eoid)
 {
-    assert (_casycom_error && "you must first set the error with casycom_error");
+    assert (_casycom_ctx->error && "you must first set the error with casycom_error");
+    assert (!_casycom_worker_mailbox && "errors on workers are forwarded by the loop thread");
     // See if the object can handle the error
-    MsgLink* ml = casycom_find_destination (oid);
+    OSlot* ml = casycom_find_destination (oid);
     if (!ml)	// no further links in the chain, set to unhandled
 	return false;
-    DEBUG_PRINTF ("[E] Handling error in object %hu\n", ml->h.dest);
-    if (ml->o && ml->factory->error && ml->factory->error (ml->o, eoid, _casycom_error)) {
+    DEBUG_PRINTF ("[E] Handling error in object %hu\n", oid);
+    const oid_t creator = ml->links.d[0].src;	// the error handler may modify OMap
+    const Factory* f = casycom_slot_factory (ml);
+    Mailbox* mb = ml->mailbox;
+    if (mb)	// The worker must not run the object during the error handler
+	casycom_mailbox_hold (mb);
+    bool handled = ml->o && f->error && f->error (ml->o, eoid, _casycom_ctx->error);
+    if (mb)
+	casycom_mailbox_unhold (mb);
+    if (handled) {
 	DEBUG_PRINTF ("[E] Error handled\n");
-	xfree (_casycom_error);
+	xfree (_casycom_ctx->error);
 	return true;
     }
-    assert (ml->h.src != oid && "an object is never created by itself; use oid_Broadcast as creator for static objects");
+    assert (creator != oid && "an object is never created by itself; use oid_Broadcast as creator for static objects");
     // If not, fail this object and forward to creator
-    return casycom_forward_error (ml->h.src, oid);
+    return casycom_forward_error (creator, oid);
 }
@@ -11,9 +11,28 @@ typedef struct _Factory {
     void		(*destroy)(void* o);
     void		(*object_destroyed)(void* o, oid_t oid);
     bool		(*error)(void* o, oid_t eoid, const char* msg);
+    /// When object_size is set, objects are allocated zeroed from a
+    /// per-factory pool, and passed to init instead of calling create.
+    /// destroy, if set, must then release only what the object owns.
+    void		(*init)(void* o, const Msg* msg);
+    /// Called when a message is sent to the object while none are queued
+    /// for it. Returns true when it took the message, which then is not
+    /// queued. Lets relays pass messages on without a loop iteration.
+    bool		(*route)(void* o, Msg* msg);
+    size_t		object_size;
     const void* const	dtable[];
 } Factory;
 
+/// Message loop state; each thread has a current context
+typedef struct _CasycomContext CasycomContext;
+
+/// Per-context state of other casycom modules
+enum ECasycomContextSlot {
+    CASYCOM_CONTEXT_TIMER,
+    CASYCOM_CONTEXT_EXTERN,
+    CASYCOM_CONTEXT_SLOTS
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,11 +46,25 @@ bool	casycom_is_quitting (void) noexcept;
 bool	casycom_is_failed (void) noexcept;
 int	casycom_exit_code (void) noexcept;
 bool	casycom_loop_once (void) noexcept;
+void	casycom_enable_msg_arena (void) noexcept;
+void	casycom_enable_workers (unsigned n) noexcept;
+
+CasycomContext*	casycom_context_create (void) noexcept;
+void		casycom_context_free (CasycomContext* ctx) noexcept;
+void		casycom_set_context (CasycomContext* ctx) noexcept;
+CasycomContext*	casycom_context (void) noexcept;
+void**		casycom_context_slot (enum ECasycomContextSlot s) noexcept;	///< For timer.c and xcom.c
+int		casycom_wakeup_fd (void) noexcept;	///< For timer.c
+uint32_t	casycom_queued_messages (oid_t oid) noexcept;	///< For timer.c
+uint32_t	casycom_delivered_messages (oid_t oid) noexcept;	///< For timer.c
+void		casycom_async_begin (void) noexcept;
+void		casycom_async_end (void) noexcept;
 
 typedef void* (pfn_object_init)(const Msg* msg);
 
 void	casycom_register (const Factory* o) noexcept NONNULL();
 void	casycom_register_default (const Factory* o) noexcept;
+void	casycom_register_threaded (const Factory* o) noexcept NONNULL();
 void*	casycom_create_object (const iid_t iid) noexcept NONNULL();
 iid_t	casycom_interface_by_name (const char* iname) noexcept NONNULL();
 Proxy	casycom_create_proxy (iid_t iid, oid_t src) noexcept;
@@ -6,14 +6,216 @@
 #include "main.h"
 #include "vector.h"
 
+//{{{ Message pools
+
+// Each message is allocated together with its body, when the body is
+// no larger than MESSAGE_INLINE_BODY_MAX, in a block from one of the
+// size classes below. Released messages are cached in a free list per
+// class, linked through the body pointer, for reuse by casymsg_begin.
+// Larger bodies are allocated separately and attached to a class 0
+// message, which has no inline body space.
+//
+// The pools belong to each thread, like the arenas below, so that no
+// lock is needed. Each message records the id of the thread that
+// allocated it, and a message freed by another thread goes back to malloc.
+
+enum {
+    c_MsgPoolMaxFree = 256,	// Per class cache limit
+    c_MsgPoolArena = UINT8_MAX	// Msg.pool of messages allocated from an arena
+};
+
+typedef struct _MsgPool {
+    Msg*	free;
+    uint32_t	nfree;
+    uint64_t	hits;
+    uint64_t	misses;
+} MsgPool;
+
+static const uint32_t _casymsg_pool_bodysz [MESSAGE_POOL_CLASSES] = { 0, 16, 32, MESSAGE_INLINE_BODY_MAX };
+static _Thread_local MsgPool _casymsg_pools [MESSAGE_POOL_CLASSES] = {};
+static _Thread_local uint16_t _casymsg_thread = 0;
+static _Atomic(uint16_t) _casymsg_last_thread = 0;
+
+// Thread ids are assigned on first use, skipping 0. When they wrap, two
+// threads may share one, and each caches the other's messages, harmlessly.
+static uint16_t casymsg_thread_id (void)
+{
+    while (!_casymsg_thread)
+	_casymsg_thread = atomic_fetch_add (&_casymsg_last_thread, 1) + 1;
+    return _casymsg_thread;
+}
+
+static unsigned casymsg_pool_for_size (uint32_t asz)
+{
+    for (unsigned p = 0; p < MESSAGE_POOL_CLASSES; ++p)
+	if (asz <= _casymsg_pool_bodysz[p])
+	    return p;
+    return 0;	// too large for inline storage
+}
+
+static Msg* casymsg_pool_alloc (unsigned pool)
+{
+    MsgPool* p = &_casymsg_pools[pool];
+    Msg* msg = p->free;
+    size_t msz = sizeof(Msg) + _casymsg_pool_bodysz[pool];
+    if (msg) {
+	p->free = msg->body;
+	--p->nfree;
+	++p->hits;
+	memset (msg, 0, msz);	// bodies are expected to be zeroed, like xalloc does
+    } else {
+	++p->misses;
+	msg = xalloc (msz);
+    }
+    msg->thread = casymsg_thread_id();
+    return msg;
+}
+
+static inline bool casymsg_body_is_inline (const Msg* msg)
+    { return msg->pool && msg->body == (const void*)(msg+1); }
+
+//}}}-------------------------------------------------------------------
+//{{{ Message arenas
+
+// When enabled by the main loop, messages created while delivering the
+// input queue are allocated, with their bodies, from a bump allocator.
+// Such messages are delivered and freed during the next pass, so two
+// arenas are used alternately, and each is reset wholesale after the
+// messages allocated from it are freed. The arenas belong to the thread
+// running the loop, so that each casycom context has its own, and messages
+// created by other threads are unaffected. Messages that must
+// outlive the next pass, like those queued in Extern, are moved to the
+// heap with casymsg_promote.
+
+enum {
+    c_MsgArenaChunkSize = 64*1024,
+    c_MsgArenaMaxBody = c_MsgArenaChunkSize/16	// Larger messages use the pools
+};
+
+typedef struct _MsgArenaChunk {
+    struct _MsgArenaChunk*	next;
+    size_t			used;
+    char			d [c_MsgArenaChunkSize];
+} MsgArenaChunk;
+
+typedef struct _MsgArena {
+    MsgArenaChunk*	first;
+    MsgArenaChunk*	cur;
+} MsgArena;
+
+static _Thread_local MsgArena _casymsg_arenas [2] = {};
+static _Thread_local MsgArena* _casymsg_arena = NULL;
+
+static void* casymsg_arena_alloc (size_t sz)
+{
+    MsgArena* a = _casymsg_arena;
+    sz = ceilg (sz, MESSAGE_BODY_ALIGNMENT);
+    if (!a->cur)
+	a->cur = a->first = xalloc (sizeof(MsgArenaChunk));
+    while (a->cur->used + sz > sizeof(a->cur->d)) {	// chunks are kept on reset, so reuse the next one first
+	if (!a->cur->next)
+	    a->cur->next = xalloc (sizeof(MsgArenaChunk));
+	a->cur = a->cur->next;
+    }
+    void* p = &a->cur->d[a->cur->used];
+    a->cur->used += sz;
+    memset (p, 0, sz);
+    return p;
+}
+
+// These are privately exported to main.c . Do not use directly.
+
+/// Allocates messages created by this thread from arena \p ai, or from the pools if ai is negative
+void casymsg_arena_select (int ai)
+{
+    assert (ai < (int) ARRAY_SIZE(_casymsg_arenas) && "invalid message arena index");
+    _casymsg_arena = ai < 0 ? NULL : &_casymsg_arenas[ai];
+}
+
+/// Releases all messages allocated from arena \p ai
+void casymsg_arena_reset (unsigned ai)
+{
+    MsgArena* a = &_casymsg_arenas[ai];
+    for (MsgArenaChunk* c = a->first; c; c = c->next)
+	c->used = 0;
+    a->cur = a->first;
+}
+
+/// Frees the arenas of this thread; none of their messages may remain
+void casymsg_arena_free (void)
+{
+    for (size_t ai = 0; ai < ARRAY_SIZE(_casymsg_arenas); ++ai) {
+	MsgArena* a = &_casymsg_arenas[ai];
+	for (MsgArenaChunk* c = a->first, *n; c; c = n) {
+	    n = c->next;
+	    xfree (c);
+	}
+	a->first = a->cur = NULL;
+    }
+    _casymsg_arena = NULL;
+}
+
+/// Frees \p msg and its body. Use casymsg_free macro instead.
+void casymsg_release (Msg* msg)
+{
+    if (!msg)
+	return;
+    if (!casymsg_body_is_inline (msg))
+	xfree (msg->body);
+    if (msg->pool == c_MsgPoolArena)
+	return;	// freed by casymsg_arena_reset
+    MsgPool* p = &_casymsg_pools[msg->pool];
+    if (msg->thread == _casymsg_thread && p->nfree < c_MsgPoolMaxFree) {
+	msg->body = p->free;
+	p->free = msg;
+	++p->nfree;
+    } else	// Cached by another thread, or the cache is full
+	xfree (msg);
+}
+
+/// Copies allocation counters for each message size class of this thread into \p stats
+void casymsg_pool_stats (MsgPoolStats stats [MESSAGE_POOL_CLASSES])
+{
+    for (unsigned p = 0; p < MESSAGE_POOL_CLASSES; ++p) {
+	stats[p].bodysz = _casymsg_pool_bodysz[p];
+	stats[p].nfree = _casymsg_pools[p].nfree;
+	stats[p].hits = _casymsg_pools[p].hits;
+	stats[p].misses = _casymsg_pools[p].misses;
+    }
+}
+
+// This is privately exported to main.c . Do not use directly.
+/// Frees the messages cached by this thread
+void casymsg_pool_free (void)
+{
+    for (unsigned p = 0; p < MESSAGE_POOL_CLASSES; ++p) {
+	for (Msg* m = _casymsg_pools[p].free, *n; m; m = n) {
+	    n = m->body;
+	    xfree (m);
+	}
+	_casymsg_pools[p].free = NULL;
+	_casymsg_pools[p].nfree = 0;
+    }
+}
+
+//}}}-------------------------------------------------------------------
+
 Msg* casymsg_begin (const Proxy* pp, uint32_t imethod, uint32_t sz)
 {
-    Msg* msg = xalloc (sizeof(Msg));
+    uint32_t asz = ceilg (sz, MESSAGE_BODY_ALIGNMENT);
+    unsigned pool;
+    Msg* msg;
+    if (_casymsg_arena && asz <= c_MsgArenaMaxBody) {
+	pool = c_MsgPoolArena;
+	msg = casymsg_arena_alloc (sizeof(Msg)+asz);
+    } else
+	msg = casymsg_pool_alloc (pool = casymsg_pool_for_size (asz));
     msg->h = *pp;
     msg->imethod = imethod;
     msg->fdoffset = NO_FD_IN_MESSAGE;
+    msg->pool = pool;
     if ((msg->size = sz))
-	msg->body = xalloc (ceilg (sz, MESSAGE_BODY_ALIGNMENT));
+	msg->body = pool ? (void*)(msg+1) : xalloc (asz);
     return msg;
 }
 
@@ -31,16 +233,47 @@ void casymsg_from_vector (const Proxy* pp, uint32_t imethod, void* body)
     casymsg_end (msg);
 }
 
-void casymsg_forward (const Proxy* pp, Msg* msg)
+/// Returns a new heap allocated message with the contents of \p msg, leaving its body empty
+Msg* casymsg_move (Msg* msg)
 {
-    Msg* fwm = casymsg_begin (pp, msg->imethod, 0);
-    fwm->h.interface = msg->h.interface;
-    fwm->body = msg->body;
-    fwm->size = msg->size;
-    fwm->extid = msg->extid;
-    fwm->fdoffset = msg->fdoffset;
+    Msg* m;
+    if (casymsg_body_is_inline (msg)) {	// inline bodies must be copied
+	uint32_t asz = ceilg (msg->size, MESSAGE_BODY_ALIGNMENT);
+	unsigned pool = casymsg_pool_for_size (asz);
+	m = casymsg_pool_alloc (pool);
+	*m = *msg;
+	m->pool = pool;
+	m->thread = _casymsg_thread;
+	m->body = pool ? (void*)(m+1) : xalloc (asz);
+	memcpy (m->body, msg->body, asz);
+    } else {	// separate bodies are transferred
+	m = casymsg_pool_alloc (0);
+	*m = *msg;
+	m->pool = 0;
+	m->thread = _casymsg_thread;
+    }
     msg->size = 0;
     msg->body = NULL;
+    return m;
+}
+
+/// Returns \p msg, or its heap copy if it was allocated from a message arena.
+/// Messages kept past the loop iteration following their creation must be promoted.
+Msg* casymsg_promote (Msg* msg)
+{
+    if (msg->pool != c_MsgPoolArena)
+	return msg;
+    Msg* m = casymsg_move (msg);
+    casymsg_release (msg);
+    return m;
+}
+
+void casymsg_forward (const Proxy* pp, Msg* msg)
+{
+    iid_t iid = msg->h.interface;
+    Msg* fwm = casymsg_move (msg);
+    fwm->h = *pp;
+    fwm->h.interface = iid;
     casymsg_end (fwm);
 }
 
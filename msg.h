@@ -31,6 +31,7 @@ typedef struct _Proxy {
     iid_t	interface;
     oid_t	src;
     oid_t	dest;
+    uint16_t	gen;	///< Generation of dest, to detect oid reuse
 } Proxy;
 
 #define PROXY_INIT	{}
@@ -41,14 +42,18 @@ typedef struct _Msg {
     uint32_t	size;
     oid_t	extid;
     uint8_t	fdoffset;
-    uint8_t	reserved;
+    uint8_t	pool;	///< Size class the message was allocated from
+    uint16_t	thread;	///< ... by the thread with this id
     void*	body;
+    struct _Msg* next;	///< Link in the queue of messages from other threads
 } Msg;
 
 enum {
     NO_FD_IN_MESSAGE = UINT8_MAX,
     MESSAGE_HEADER_ALIGNMENT = 8,
     MESSAGE_BODY_ALIGNMENT = MESSAGE_HEADER_ALIGNMENT,
+    MESSAGE_INLINE_BODY_MAX = 64,	///< Larger bodies are allocated separately
+    MESSAGE_POOL_CLASSES = 4,
     method_invalid = (uint32_t)-2,
     method_create_object = (uint32_t)-1
 };
@@ -61,6 +66,14 @@ typedef struct _DTable {
 
 typedef void (*pfn_dispatch)(const void* dtable, void* o, const Msg* msg);
 
+/// Allocation counters of a message size class, from casymsg_pool_stats
+typedef struct _MsgPoolStats {
+    uint32_t	bodysz;	///< Largest body stored inline in this class
+    uint32_t	nfree;	///< Freed messages currently cached for reuse
+    uint64_t	hits;	///< Allocations served from the cache
+    uint64_t	misses;	///< Allocations that required malloc
+} MsgPoolStats;
+
 //----------------------------------------------------------------------
 
 #ifdef __cplusplus
@@ -70,7 +83,15 @@ extern "C" {
 Msg*	casymsg_begin (const Proxy* pp, uint32_t imethod, uint32_t sz) noexcept NONNULL() MALLOCLIKE;
 void	casymsg_from_vector (const Proxy* pp, uint32_t imethod, void* body) noexcept NONNULL();
 void	casymsg_forward (const Proxy* pp, Msg* msg) noexcept NONNULL();
+Msg*	casymsg_move (Msg* msg) noexcept NONNULL() MALLOCLIKE;
+Msg*	casymsg_promote (Msg* msg) noexcept NONNULL();
+void	casymsg_release (Msg* msg) noexcept;
+void	casymsg_pool_stats (MsgPoolStats stats [MESSAGE_POOL_CLASSES]) noexcept NONNULL();
 void	casycom_queue_message (Msg* msg) noexcept NONNULL(); ///< In main.c
+void	casymsg_arena_select (int ai) noexcept;	///< For main.c
+void	casymsg_arena_reset (unsigned ai) noexcept;	///< For main.c
+void	casymsg_arena_free (void) noexcept;	///< For main.c
+void	casymsg_pool_free (void) noexcept;	///< For main.c
 uint32_t casyiface_count_methods (iid_t iid) noexcept;
 size_t	casymsg_validate_signature (const Msg* msg) noexcept NONNULL();
 
@@ -108,7 +129,7 @@ static inline int casymsg_read_fd (const Msg* msg UNUSED, RStm* is) {
 }
 
 #define casymsg_free(msg)	\
-    do { if (msg) xfree (msg->body); xfree (msg); } while (false)
+    do { casymsg_release (msg); msg = NULL; } while (false)
 
 static inline void casymsg_default_dispatch (const void* dtable UNUSED, void* o UNUSED, const Msg* msg)
 {
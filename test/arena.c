@@ -0,0 +1,66 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// With casycom_enable_msg_arena, messages created while delivering a
+// pass are allocated from an arena, which is reset after the next pass.
+// A message kept longer than that must be moved to the heap with
+// casymsg_promote. Here the app creates a ping message, keeps it while
+// several other pings go back and forth, and then sends it.
+
+enum { KeptPing = 100, NPings = 5 };
+
+typedef struct _App {
+    Proxy	pingp;
+    Msg*	kept;
+} App;
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_msg_arena();
+    casycom_register (&f_Ping);
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 1);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    LOG ("Ping %u reply received in app\n", u);
+    if (u == 1) {
+	// Write a ping message now, and send it later
+	Msg* msg = casymsg_begin (&app->pingp, 0, sizeof(uint32_t));
+	WStm os = casymsg_write (msg);
+	casystm_write_uint32 (&os, KeptPing);
+	app->kept = casymsg_promote (msg);
+    }
+    if (u < NPings)
+	PPing_ping (&app->pingp, u+1);
+    else if (app->kept) {
+	casymsg_end (app->kept);
+	app->kept = NULL;
+    } else
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,198 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <sys/wait.h>
+
+//----------------------------------------------------------------------
+// The Extern reads the socket into a 64k buffer, parsing all complete
+// messages in it, and keeping a partial one for the next read. Messages
+// larger than the buffer are read directly into their own body.
+//
+// Here the app forks a server, as in ipcom, and sends it a burst of
+// strings of various sizes, small, larger than the buffer, and sized to
+// straddle its end. The server echoes each back, and the app checks them.
+
+//{{{ Echo interface ---------------------------------------------------
+
+typedef void (*MFN_Echo_text)(void* vo, const char* s);
+typedef struct _DEcho {
+    iid_t		interface;
+    MFN_Echo_text	Echo_text;
+} DEcho;
+
+enum { method_Echo_text };
+
+static void PEcho_text (const Proxy* pp, const char* s)
+{
+    Msg* msg = casymsg_begin (pp, method_Echo_text, casystm_size_string (s));
+    WStm os = casymsg_write (msg);
+    casystm_write_string (&os, s);
+    casymsg_end (msg);
+}
+
+static void Echo_dispatch (const DEcho* dtable, void* o, const Msg* msg)
+{
+    if (msg->imethod == method_Echo_text) {
+	RStm is = casymsg_read (msg);
+	const char* s = casystm_read_string (&is);
+	dtable->Echo_text (o, s);
+    } else
+	casymsg_default_dispatch (dtable, o, msg);
+}
+
+static const Interface i_Echo = {
+    .name	= "Echo",
+    .dispatch	= Echo_dispatch,
+    .method	= { "text\0s", NULL }
+};
+
+typedef void (*MFN_EchoR_text)(void* vo, const char* s);
+typedef struct _DEchoR {
+    iid_t		interface;
+    MFN_EchoR_text	EchoR_text;
+} DEchoR;
+
+static void EchoR_dispatch (const DEchoR* dtable, void* o, const Msg* msg)
+{
+    if (msg->imethod == method_Echo_text) {
+	RStm is = casymsg_read (msg);
+	const char* s = casystm_read_string (&is);
+	dtable->EchoR_text (o, s);
+    } else
+	casymsg_default_dispatch (dtable, o, msg);
+}
+
+// Replies are sent with PEcho_text on an EchoR proxy
+static const Interface i_EchoR = {
+    .name	= "EchoR",
+    .dispatch	= EchoR_dispatch,
+    .method	= { "text\0s", NULL }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ Echo server object
+
+typedef struct _Echo {
+    Proxy	reply;
+} Echo;
+
+static void* Echo_create (const Msg* msg)
+{
+    Echo* o = xalloc (sizeof(Echo));
+    o->reply = casycom_create_reply_proxy (&i_EchoR, msg);
+    return o;
+}
+
+static void Echo_destroy (void* o)
+    { xfree (o); }
+
+static void Echo_Echo_text (Echo* o, const char* s)
+    { PEcho_text (&o->reply, s); }
+
+static const DEcho d_Echo_Echo = {
+    .interface = &i_Echo,
+    DMETHOD (Echo, Echo_text)
+};
+static const Factory f_Echo = {
+    .create	= Echo_create,
+    .destroy	= Echo_destroy,
+    .dtable	= { &d_Echo_Echo, NULL }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ App
+
+enum { NTexts = 8 };
+static const uint32_t c_TextSize [NTexts] = { 10, 65000, 200000, 1000, 65536-64, 3, 131072, 100 };
+
+typedef struct _App {
+    Proxy	echop;
+    Proxy	externp;
+    pid_t	server_pid;
+    char*	texts [NTexts];
+    unsigned	nreplies;
+    unsigned	nmatched;
+} App;
+
+static const iid_t eil_Echo[] = { &i_Echo, NULL };
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App o = {}; return &o; }
+
+static void App_destroy (void* vapp)
+{
+    App* app = vapp;
+    for (unsigned i = 0; i < NTexts; ++i)
+	xfree (app->texts[i]);
+    if (app->server_pid > 0)
+	waitpid (app->server_pid, NULL, 0);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_externs();
+    int socks[2];
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, socks))
+	return casycom_error ("socketpair: %s", strerror(errno));
+    int fr = fork();
+    if (fr < 0)
+	return casycom_error ("fork: %s", strerror(errno));
+    app->externp = casycom_create_proxy (&i_Extern, oid_App);
+    if (fr == 0) {	// Server side
+	close (socks[0]);
+	casycom_register (&f_Echo);
+	PExtern_open (&app->externp, socks[1], EXTERN_SERVER, NULL, eil_Echo);
+    } else {		// Client side
+	app->server_pid = fr;
+	close (socks[1]);
+	PExtern_open (&app->externp, socks[0], EXTERN_CLIENT, eil_Echo, NULL);
+    }
+}
+
+static void App_ExternR_connected (App* app, const ExternInfo* einfo UNUSED)
+{
+    if (!app->server_pid)
+	return;
+    app->echop = casycom_create_proxy (&i_Echo, oid_App);
+    for (unsigned i = 0; i < NTexts; ++i) {
+	const uint32_t n = c_TextSize[i];
+	app->texts[i] = xalloc (n+1);
+	for (uint32_t j = 0; j < n; ++j)
+	    app->texts[i][j] = 'a' + (i+j) % 26;
+	PEcho_text (&app->echop, app->texts[i]);
+    }
+}
+
+static void App_EchoR_text (App* app, const char* s)
+{
+    if (app->nreplies < NTexts && 0 == strcmp (s, app->texts[app->nreplies]))
+	++app->nmatched;
+    if (++app->nreplies < NTexts)
+	return;
+    LOG ("Sent %u texts of up to 200000 bytes, %u echoed back unchanged\n", NTexts, app->nmatched);
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DEchoR d_App_EchoR = {
+    .interface = &i_EchoR,
+    DMETHOD (App, EchoR_text)
+};
+static const DExternR d_App_ExternR = {
+    .interface = &i_ExternR,
+    DMETHOD (App, ExternR_connected)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_EchoR, &d_App_ExternR, NULL }
+};
+CASYCOM_MAIN (f_App)
+
+//}}}-------------------------------------------------------------------
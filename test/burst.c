@@ -0,0 +1,130 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <sys/wait.h>
+
+//----------------------------------------------------------------------
+// Messages to remote objects are queued in the Extern, and sent together
+// when the socket is writable, with one sendmsg for as many as fit. On
+// the other side, all messages read are parsed out of the buffer.
+//
+// Here the app forks a server, as in ipcom, and sends a burst of pings
+// at once, more than are gathered into one sendmsg. The server replies
+// to each, and the replies must arrive complete and in order. To keep
+// the output short, the server object does not log each ping.
+
+enum { NPings = 500 };
+
+typedef struct _App {
+    Proxy	pingp;
+    Proxy	externp;
+    pid_t	server_pid;
+    unsigned	nreplies;
+    unsigned	ninorder;
+} App;
+
+static const iid_t eil_Ping[] = { &i_Ping, NULL };
+
+//----------------------------------------------------------------------
+// Replies to pings without logging them
+
+typedef struct _Echo {
+    Proxy	reply;
+} Echo;
+
+static void* Echo_create (const Msg* msg)
+{
+    Echo* o = xalloc (sizeof(Echo));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    return o;
+}
+
+static void Echo_destroy (void* o)
+    { xfree (o); }
+
+static void Echo_Ping_ping (Echo* o, uint32_t u)
+    { PPingR_ping (&o->reply, u); }
+
+static const DPing d_Echo_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Echo, Ping_ping)
+};
+static const Factory f_Echo = {
+    .create	= Echo_create,
+    .destroy	= Echo_destroy,
+    .dtable	= { &d_Echo_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App o = {}; return &o; }
+
+static void App_destroy (void* vapp)
+{
+    const App* app = vapp;
+    if (app->server_pid > 0)
+	waitpid (app->server_pid, NULL, 0);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_externs();
+    int socks[2];
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, socks))
+	return casycom_error ("socketpair: %s", strerror(errno));
+    int fr = fork();
+    if (fr < 0)
+	return casycom_error ("fork: %s", strerror(errno));
+    app->externp = casycom_create_proxy (&i_Extern, oid_App);
+    if (fr == 0) {	// Server side
+	close (socks[0]);
+	casycom_register (&f_Echo);
+	PExtern_open (&app->externp, socks[1], EXTERN_SERVER, NULL, eil_Ping);
+    } else {		// Client side
+	app->server_pid = fr;
+	close (socks[1]);
+	PExtern_open (&app->externp, socks[0], EXTERN_CLIENT, eil_Ping, NULL);
+    }
+}
+
+static void App_ExternR_connected (App* app, const ExternInfo* einfo UNUSED)
+{
+    if (!app->server_pid)
+	return;
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    for (unsigned i = 0; i < NPings; ++i)
+	PPing_ping (&app->pingp, i);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    if (u == app->nreplies)
+	++app->ninorder;
+    if (++app->nreplies < NPings)
+	return;
+    LOG ("Sent %u pings, received %u replies, %u in order\n", NPings, app->nreplies, app->ninorder);
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DExternR d_App_ExternR = {
+    .interface = &i_ExternR,
+    DMETHOD (App, ExternR_connected)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_ExternR, NULL }
+};
+CASYCOM_MAIN (f_App)
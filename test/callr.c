@@ -0,0 +1,111 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// When an object is destroyed, every object holding a proxy to it gets
+// the object_destroyed call. This test has more callers of one object
+// than the fixed number once notified, and checks that all are.
+
+enum { NClients = 40, ClientPing = 1000 };
+
+typedef struct _App {
+    Proxy	servicep;
+    Proxy	clientp [NClients];
+    unsigned	nnotified;
+} App;
+
+//----------------------------------------------------------------------
+// A Node pinged with 0 is the service. Other Nodes are clients, pinged
+// with the oid of the service, to which they each create a proxy.
+
+typedef struct _Node {
+    Proxy	reply;
+    Proxy	servicep;
+    unsigned	npings;
+} Node;
+
+static void* Node_create (const Msg* msg)
+{
+    Node* o = xalloc (sizeof(Node));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    return o;
+}
+
+static void Node_destroy (void* o)
+    { xfree (o); }
+
+static void Node_Ping_ping (Node* o, uint32_t u)
+{
+    if (!u)	// The service is ready
+	PPingR_ping (&o->reply, u);
+    else if (u < ClientPing) {	// A client, to connect to service oid u
+	o->servicep = casycom_create_proxy_to (&i_Ping, casycom_oid_of_object (o), u);
+	PPing_ping (&o->servicep, ClientPing);
+    } else if (++o->npings == NClients) {
+	LOG ("Service pinged by %u clients\n", o->npings);
+	casycom_mark_unused (o);
+    }
+}
+
+static void Node_object_destroyed (void* vo, oid_t oid)
+{
+    Node* o = vo;
+    if (o->servicep.interface && oid == o->servicep.dest)
+	PPingR_ping (&o->reply, oid);
+}
+
+static const DPing d_Node_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Node, Ping_ping)
+};
+static const Factory f_Node = {
+    .create	= Node_create,
+    .destroy	= Node_destroy,
+    .object_destroyed = Node_object_destroyed,
+    .dtable	= { &d_Node_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Node);
+    app->servicep = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->servicep, 0);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    if (!u) {	// The service is created, connect the clients to it
+	for (unsigned i = 0; i < NClients; ++i) {
+	    app->clientp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	    PPing_ping (&app->clientp[i], app->servicep.dest);
+	}
+    } else if (++app->nnotified == NClients) {
+	LOG ("%u clients notified of service destruction\n", app->nnotified);
+	casycom_quit (EXIT_SUCCESS);
+    }
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
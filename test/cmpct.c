@@ -0,0 +1,103 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <sys/wait.h>
+
+//----------------------------------------------------------------------
+// Extern connections negotiate protocol extensions in the handshake.
+// When both sides accept compact headers, the first message of each
+// method carries the full header, defining a numeric id for the method,
+// and later messages of that method carry only the id. This is not
+// visible to the objects; ExternInfo.is_compact shows that it is used.
+//
+// Here, like in ipcom, the app forks a server on a socket pair, and
+// pings the remote object several times, so that all pings after the
+// first, and all replies after the first, are sent with compact headers.
+
+enum { NPings = 4 };
+
+typedef struct _App {
+    Proxy	pingp;
+    Proxy	externp;
+    pid_t	server_pid;
+} App;
+
+static const iid_t eil_Ping[] = { &i_Ping, NULL };
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App o = {}; return &o; }
+
+static void App_destroy (void* vapp)
+{
+    const App* app = vapp;
+    // The Extern, destroyed first, has closed the socket. The server
+    // quits when it sees that, and is waited for to keep its output
+    // ahead of whatever runs after this test.
+    if (app->server_pid > 0)
+	waitpid (app->server_pid, NULL, 0);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_externs();
+    int socks[2];
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, socks))
+	return casycom_error ("socketpair: %s", strerror(errno));
+    int fr = fork();
+    if (fr < 0)
+	return casycom_error ("fork: %s", strerror(errno));
+    app->externp = casycom_create_proxy (&i_Extern, oid_App);
+    if (fr == 0) {	// Server side
+	close (socks[0]);
+	casycom_register (&f_Ping);
+	PExtern_open (&app->externp, socks[1], EXTERN_SERVER, NULL, eil_Ping);
+    } else {		// Client side
+	app->server_pid = fr;
+	close (socks[1]);
+	PExtern_open (&app->externp, socks[0], EXTERN_CLIENT, eil_Ping, NULL);
+    }
+}
+
+static void App_ExternR_connected (App* app, const ExternInfo* einfo)
+{
+    if (!app->server_pid)
+	return;	// log only the client side
+    LOG ("Connected to server. Compact headers are %s\n", einfo->is_compact ? "used" : "not used");
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 1);
+}
+
+// Each ping is sent after the previous reply, to keep the output of the
+// two processes in order.
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    LOG ("Ping %u reply received in app\n", u);
+    if (u < NPings)
+	PPing_ping (&app->pingp, u+1);
+    else
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DExternR d_App_ExternR = {
+    .interface = &i_ExternR,
+    DMETHOD (App, ExternR_connected)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_ExternR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,99 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include "../timer.h"
+
+//----------------------------------------------------------------------
+// Timers started with WATCH_COARSE, or after PTimer_set_slack, may fire
+// later than asked, so that timers due close together share a wakeup.
+// Here two exact timers fire in separate passes of the loop, and then
+// two coarse timers with the same timeouts fire together in one pass.
+// When the first timer's reply is handled, the app sends a message to
+// itself, which is delivered in the next pass. If the second timer has
+// fired in the same pass, its reply is delivered before that message.
+
+enum {
+    NTimers = 4,
+    FirstTimeout = 10,	// ms
+    SecondTimeout = 60
+};
+
+typedef struct _App {
+    Proxy	timerp [NTimers];
+    Proxy	selfp;
+    unsigned	nfired;
+    bool	second_fired;
+} App;
+
+static void App_start_coarse_timers (void* vapp)
+{
+    App* app = vapp;
+    // Both deadlines are now well inside one slack interval
+    PTimer_watch (&app->timerp[2], WATCH_TIMER| WATCH_COARSE, -1, FirstTimeout);
+    PTimer_watch (&app->timerp[3], WATCH_TIMER| WATCH_COARSE, -1, SecondTimeout);
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    // Timer objects are destroyed after firing once, so each watch
+    // here gets its own.
+    for (unsigned i = 0; i < NTimers; ++i)
+	app->timerp[i] = casycom_create_proxy (&i_Timer, oid_App);
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+    PTimer_timer (&app->timerp[0], FirstTimeout);
+    PTimer_timer (&app->timerp[1], SecondTimeout);
+}
+
+static void App_TimerR_timer (App* app, int fd UNUSED, const Msg* msg)
+{
+    unsigned i = 0;
+    while (i < NTimers && app->timerp[i].dest != msg->h.src)
+	++i;
+    LOG ("%s timer %u fired\n", i < 2 ? "Exact" : "Coarse", i%2+1);
+    if (i % 2 == 0) {
+	app->second_fired = false;
+	PPingR_ping (&app->selfp, i);
+    } else
+	app->second_fired = true;
+    if (++app->nfired == 2) {
+	// Slack moves a deadline onto a multiple of a power of two time
+	// interval. Starting just after such a multiple avoids straddling
+	// one, for which the two coarse timers would still fire apart.
+	Timer_timeout_start_with_slack (1, TIMER_COARSE_SLACK, App_start_coarse_timers, app);
+    }
+}
+
+// Sent by the first timer's reply handler, in the pass after it
+static void App_PingR_ping (App* app, uint32_t i)
+{
+    LOG ("%s timer 2 %s\n", i < 2 ? "Exact" : "Coarse", app->second_fired ? "fired in the same pass" : "is still waiting");
+    if (i >= 2)
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DTimerR d_App_TimerR = {
+    .interface = &i_TimerR,
+    DMETHOD (App, TimerR_timer)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_TimerR, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,114 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <pthread.h>
+
+//----------------------------------------------------------------------
+// Each thread has a current casycom context, holding all message loop
+// state. The main thread starts with the default context. To run an
+// independent message loop on another thread, create a context with
+// casycom_context_create, make it current with casycom_set_context,
+// and use casycom_init and casycom_main as usual.
+//
+// Here the app starts a thread running its own loop, with an object
+// that pings itself, and waits for it. The second loop runs while the
+// app's loop is blocked. When it exits, the thread reports to the app
+// by switching to the app's context and sending it a message.
+
+typedef struct _App {
+    Proxy	selfp;
+    pthread_t	thread;
+} App;
+
+//----------------------------------------------------------------------
+// The Counter runs in the second loop, pinging itself three times
+
+typedef struct _Counter {
+    Proxy	selfp;
+} Counter;
+
+static void Counter_init (void* vo, const Msg* msg)
+{
+    Counter* o = vo;
+    o->selfp = casycom_create_proxy_to (&i_Ping, msg->h.dest, msg->h.dest);
+    LOG ("Created Counter %u in the second loop\n", msg->h.dest);
+}
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    LOG ("Counter received ping %u\n", u);
+    if (u < 3)
+	PPing_ping (&o->selfp, u+1);
+    else
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const Factory f_Counter = {
+    .init	= Counter_init,
+    .object_size = sizeof(Counter),
+    .dtable	= { &d_Counter_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* Loop_thread (void* vapp)
+{
+    App* app = vapp;
+    CasycomContext* appctx = casycom_context();	// Inherited from the app thread
+    // Create and run the second loop
+    CasycomContext* ctx = casycom_context_create();
+    casycom_set_context (ctx);
+    casycom_init();
+    casycom_register (&f_Counter);
+    Proxy p = casycom_create_proxy (&i_Ping, oid_Broadcast);
+    PPing_ping (&p, 1);
+    int r = casycom_main();
+    LOG ("Second loop exited with %d\n", r);
+    casycom_context_free (ctx);
+    // Messages to the app are sent in its context
+    casycom_set_context (appctx);
+    PPingR_ping (&app->selfp, r);
+    casycom_set_context (NULL);
+    return NULL;
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    // The thread reports its result to the app through this proxy
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+    if (0 != pthread_create (&app->thread, NULL, Loop_thread, app))
+	return casycom_error ("pthread_create failed");
+    pthread_join (app->thread, NULL);
+}
+
+static void App_PingR_ping (App* app UNUSED, uint32_t u)
+{
+    LOG ("App received result %u from the second loop\n", u);
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
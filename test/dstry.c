@@ -0,0 +1,132 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Destroying an object destroys the objects it created, through its
+// outgoing links. Objects marked unused are queued for destruction at
+// the end of the pass, in the order they were marked.
+//
+// Here the app builds a tree of Nodes twice. The first tree is torn down
+// by destroying the root's proxy. In the second, the root and then its
+// children mark themselves unused in the same pass. The children are
+// destroyed with the root, before their own turn in the queue comes.
+
+enum { MarkUnused = 1000, MarkSelf };
+
+typedef struct _App {
+    Proxy	rootp;
+    unsigned	ntrees;
+} App;
+
+//----------------------------------------------------------------------
+// Node creates two children, unless at the bottom of the tree. It is
+// named by its path from the root, one digit per level.
+
+typedef struct _Node {
+    Proxy	reply;
+    Proxy	childp [2];
+    uint32_t	name;
+    unsigned	nreplies;
+} Node;
+
+static void* Node_create (const Msg* msg)
+{
+    Node* o = xalloc (sizeof(Node));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    return o;
+}
+
+static void Node_destroy (void* vo)
+{
+    Node* o = vo;
+    LOG ("Node %u destroyed\n", o->name);
+    xfree (o);
+}
+
+static void Node_Ping_ping (Node* o, uint32_t u)
+{
+    if (u == MarkSelf || (u == MarkUnused && o->name != 1)) {
+	LOG ("Node %u marked unused\n", o->name);
+	return casycom_mark_unused (o);
+    } else if (u == MarkUnused) {
+	// The root marks itself in the next pass, ahead of its children
+	oid_t oid = casycom_oid_of_object (o);
+	Proxy selfp = casycom_create_proxy_to (&i_Ping, oid, oid);
+	PPing_ping (&selfp, MarkSelf);
+	for (unsigned i = 0; i < ARRAY_SIZE(o->childp); ++i)
+	    PPing_ping (&o->childp[i], MarkUnused);
+	return;
+    }
+    o->name = u;
+    if (u >= 100)	// The bottom of the tree
+	return PPingR_ping (&o->reply, u);
+    for (unsigned i = 0; i < ARRAY_SIZE(o->childp); ++i) {
+	o->childp[i] = casycom_create_proxy (&i_Ping, casycom_oid_of_object (o));
+	PPing_ping (&o->childp[i], u*10+i+1);
+    }
+}
+
+static void Node_PingR_ping (Node* o, uint32_t u UNUSED)
+{
+    if (++o->nreplies == ARRAY_SIZE(o->childp))
+	PPingR_ping (&o->reply, o->name);
+}
+
+static const DPing d_Node_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Node, Ping_ping)
+};
+static const DPingR d_Node_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (Node, PingR_ping)
+};
+static const Factory f_Node = {
+    .create	= Node_create,
+    .destroy	= Node_destroy,
+    .dtable	= { &d_Node_Ping, &d_Node_PingR, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Node);
+    app->rootp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->rootp, 1);
+}
+
+static void App_PingR_ping (App* app, uint32_t u UNUSED)
+{
+    if (++app->ntrees == 1) {
+	LOG ("Tree built. Destroying the root proxy\n");
+	casycom_destroy_proxy (&app->rootp);
+	app->rootp = casycom_create_proxy (&i_Ping, oid_App);
+	PPing_ping (&app->rootp, 1);
+    } else {
+	LOG ("Tree built. Marking the nodes unused\n");
+	PPing_ping (&app->rootp, MarkUnused);
+    }
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,105 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Each registered interface gets a dense index, through which messages
+// find the factory to create their destination, and the dtable of the
+// destination object. This test has an object implementing two
+// interfaces, Ping and TimerR, with a factory registered after Timer's,
+// and checks that each message is dispatched through the right dtable.
+
+enum { NCounters = 3 };
+
+typedef struct _App {
+    Proxy	pingp [NCounters];
+    unsigned	nreplies;
+} App;
+
+//----------------------------------------------------------------------
+// On each ping, the Counter starts a timer, and replies when it fires
+
+typedef struct _Counter {
+    Proxy	reply;
+    Proxy	timer;
+    uint32_t	id;
+} Counter;
+
+static void* Counter_create (const Msg* msg)
+{
+    Counter* o = xalloc (sizeof(Counter));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    o->timer = casycom_create_proxy (&i_Timer, msg->h.dest);
+    return o;
+}
+
+static void Counter_destroy (void* o)
+    { xfree (o); }
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    LOG ("Counter %u received Ping.ping\n", u);
+    o->id = u;
+    PTimer_timer (&o->timer, u*20);
+}
+
+static void Counter_TimerR_timer (Counter* o, int fd UNUSED, const Msg* msg UNUSED)
+{
+    LOG ("Counter %u received TimerR.timer\n", o->id);
+    PPingR_ping (&o->reply, o->id);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const DTimerR d_Counter_TimerR = {
+    .interface = &i_TimerR,
+    DMETHOD (Counter, TimerR_timer)
+};
+static const Factory f_Counter = {
+    .create	= Counter_create,
+    .destroy	= Counter_destroy,
+    .dtable	= { &d_Counter_Ping, &d_Counter_TimerR, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    casycom_register (&f_Counter);
+    for (unsigned i = 0; i < NCounters; ++i) {
+	app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	PPing_ping (&app->pingp[i], i+1);
+    }
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    LOG ("App received PingR.ping %u\n", u);
+    if (++app->nreplies == NCounters)
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
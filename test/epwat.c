@@ -0,0 +1,104 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Timer objects watch fds for readiness, optionally with a timeout.
+// Several timers may watch the same fd, each getting its own reply,
+// and a stopped watch no longer fires, even if the fd is ready. Files
+// that can not be waited for, like regular files, are always ready.
+// Watching an fd that is not open is an error.
+//
+// Here two timers wait to read the same pipe, which has data, a third
+// is stopped before it fires, and a fourth waits on an empty pipe with
+// a timeout, firing last. Another waits to read stdin, redirected from
+// a file by make check, and one more watches an fd that is not open.
+
+enum {
+    NTimers = 6,
+    NPipeTimers = 3,
+    StdinTimer = 4,
+    ClosedFdTimer,
+    EmptyPipeTimeout = 20,	// ms
+    StdinTimeout = 1000,
+    ClosedFd = 999
+};
+
+typedef struct _App {
+    Proxy	timerp [NTimers];
+    int		fullpipe [2];
+    int		emptypipe [2];
+    unsigned	nfired [NTimers];
+} App;
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+
+static void App_destroy (void* vapp)
+{
+    App* app = vapp;
+    for (unsigned i = 0; i < 2; ++i) {
+	close (app->fullpipe[i]);
+	close (app->emptypipe[i]);
+    }
+}
+
+static bool App_error (void* vapp UNUSED, oid_t eoid UNUSED, const char* msg)
+{
+    LOG ("Error: %s\n", msg);
+    return true;
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    if (0 > pipe (app->fullpipe) || 0 > pipe (app->emptypipe))
+	return casycom_error ("pipe: %s", strerror(errno));
+    if (0 > write (app->fullpipe[1], "x", 1))
+	return casycom_error ("write: %s", strerror(errno));
+    for (unsigned i = 0; i < NTimers; ++i)
+	app->timerp[i] = casycom_create_proxy (&i_Timer, oid_App);
+    PTimer_wait_read (&app->timerp[0], app->fullpipe[0]);
+    PTimer_wait_read (&app->timerp[1], app->fullpipe[0]);
+    PTimer_wait_read (&app->timerp[2], app->fullpipe[0]);
+    PTimer_stop (&app->timerp[2]);
+    PTimer_wait_read_with_timeout (&app->timerp[3], app->emptypipe[0], EmptyPipeTimeout);
+    PTimer_wait_read_with_timeout (&app->timerp[StdinTimer], STDIN_FILENO, StdinTimeout);
+    PTimer_wait_read (&app->timerp[ClosedFdTimer], ClosedFd);
+}
+
+static void App_TimerR_timer (App* app, int fd, const Msg* msg)
+{
+    unsigned i = 0;
+    while (i < NTimers && app->timerp[i].dest != msg->h.src)
+	++i;
+    if (i >= NTimers)
+	return casycom_error ("reply from an unknown timer");
+    ++app->nfired[i];
+    if (fd != app->emptypipe[0])
+	return;
+    LOG ("Timeout on the empty pipe fired\n");
+    for (i = 0; i < NPipeTimers; ++i)
+	LOG ("Timer %u on the full pipe fired %u times\n", i, app->nfired[i]);
+    LOG ("Timer on stdin fired %u times\n", app->nfired[StdinTimer]);
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DTimerR d_App_TimerR = {
+    .interface = &i_TimerR,
+    DMETHOD (App, TimerR_timer)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .error	= App_error,
+    .dtable	= { &d_App_App, &d_App_TimerR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,95 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// An FdIO failing a transfer sets an error, which is forwarded to its
+// creator, as for any other object, from the message it was handling.
+// Transfers through the io ring also fail in a message to the FdIO, and
+// not while the loop waits for events, in which case the error would be
+// charged to whichever object gets the next message.
+//
+// Here the app asks an FdIO to read from the write end of a pipe, while
+// sending itself a message in every pass, and checks that the error it
+// gets comes from the FdIO.
+
+enum { MaxPasses = 1000 };
+
+typedef struct _App {
+    Proxy	readerp;
+    Proxy	selfp;
+    int		pipefd [2];
+    CharVector	rbuf;
+} App;
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = { .rbuf = VECTOR_INIT(CharVector) }; return &app; }
+
+static void App_destroy (void* vapp)
+{
+    App* app = vapp;
+    close (app->pipefd[0]);
+    close (app->pipefd[1]);
+    vector_deallocate (&app->rbuf);
+}
+
+static bool App_error (void* vapp, oid_t eoid, const char* msg)
+{
+    App* app = vapp;
+    LOG ("Error from the %s: %s\n", eoid == app->readerp.dest ? "reader" : "app", msg);
+    casycom_quit (EXIT_SUCCESS);
+    return true;
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    casycom_register (&f_FdIO);
+    if (0 > pipe (app->pipefd))
+	return casycom_error ("pipe: %s", strerror(errno));
+    Proxy fdiop = casycom_create_proxy (&i_FdIO, oid_App);
+    PFdIO_attach (&fdiop, app->pipefd[1]);
+    app->readerp = casycom_create_proxy_to (&i_IO, oid_App, fdiop.dest);
+    vector_reserve (&app->rbuf, 64);
+    PIO_read (&app->readerp, &app->rbuf);
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+    PPingR_ping (&app->selfp, 1);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    if (u < MaxPasses)
+	PPingR_ping (&app->selfp, u+1);
+    else {
+	LOG ("The read did not fail\n");
+	casycom_quit (EXIT_FAILURE);
+    }
+}
+
+static void App_IOR_read (App* app UNUSED, CharVector* d UNUSED)
+{
+    LOG ("Read from the write end of the pipe\n");
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DIOR d_App_IOR = {
+    .interface = &i_IOR,
+    DMETHOD (App, IOR_read)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .error	= App_error,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_IOR, NULL }
+};
+CASYCOM_MAIN (f_App)
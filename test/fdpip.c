@@ -0,0 +1,171 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <fcntl.h>
+
+//----------------------------------------------------------------------
+// FdIO objects transfer data asynchronously on an fd, through the IO
+// interface. A write replies when the whole buffer is written, and a
+// read each time some data is read into the space left in the buffer.
+// When built with io_uring, the transfers are queued on the io ring.
+//
+// Here one FdIO writes a block larger than the pipe can hold, and the
+// other reads it, each waiting for the other to make room or data. The
+// reader is given a different buffer after each read. Then the app
+// writes a few small chunks itself, each only after the reader got the
+// new buffer, so that data already being read into the previous one is
+// reported in it. When the write end is closed, a read reports the end
+// of file.
+
+enum {
+    BlockSize = 200000,
+    ReadSize = 32768,
+    NChunks = 4,
+    ChunkSize = 100
+};
+
+typedef struct _App {
+    Proxy	writerp;
+    Proxy	readerp;
+    Proxy	selfp;
+    int		pipefd [2];
+    CharVector	wbuf;
+    CharVector	rbuf [2];
+    CharVector	received;
+    unsigned	nreads;
+    unsigned	nchunks;
+    bool	written;
+    bool	eof;
+} App;
+
+static bool App_received_pattern (const App* app, size_t n)
+{
+    bool same = app->received.size == n;
+    for (size_t i = 0; same && i < n; ++i)
+	same = ((uint8_t) app->received.d[i] == (uint8_t)(i % 251));
+    return same;
+}
+
+static void App_check_done (App* app)
+{
+    if (app->nchunks) {
+	if (app->received.size < app->nchunks*ChunkSize)
+	    return;
+	if (app->nchunks < NChunks) {
+	    // Written in the next pass, after the reader gets the new buffer
+	    PPingR_ping (&app->selfp, app->nchunks);
+	    return;
+	}
+	LOG ("Wrote %u chunks, data %s\n", NChunks, App_received_pattern (app, NChunks*ChunkSize) ? "matches" : "differs");
+	// Closing the write end makes the next read report the end of file
+	close (app->pipefd[1]);
+	app->pipefd[1] = -1;
+    } else if (app->written && app->received.size >= BlockSize) {
+	LOG ("Wrote %zu bytes, read %zu bytes in %s reads, data %s\n", (size_t) BlockSize, app->received.size, app->nreads > 1 ? "several" : "one", App_received_pattern (app, BlockSize) ? "matches" : "differs");
+	vector_clear (&app->received);
+	PPingR_ping (&app->selfp, 0);
+    }
+}
+
+static void* App_create (const Msg* msg UNUSED)
+{
+    static App app = {
+	.wbuf = VECTOR_INIT(CharVector),
+	.rbuf = { VECTOR_INIT(CharVector), VECTOR_INIT(CharVector) },
+	.received = VECTOR_INIT(CharVector)
+    };
+    return &app;
+}
+
+static void App_destroy (void* vapp)
+{
+    App* app = vapp;
+    for (unsigned i = 0; i < 2; ++i) {
+	if (app->pipefd[i] >= 0)
+	    close (app->pipefd[i]);
+	vector_deallocate (&app->rbuf[i]);
+    }
+    vector_deallocate (&app->wbuf);
+    vector_deallocate (&app->received);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    casycom_register (&f_FdIO);
+    if (0 > pipe2 (app->pipefd, O_NONBLOCK))
+	return casycom_error ("pipe2: %s", strerror(errno));
+    Proxy fdiop = casycom_create_proxy (&i_FdIO, oid_App);
+    PFdIO_attach (&fdiop, app->pipefd[1]);
+    app->writerp = casycom_create_proxy_to (&i_IO, oid_App, fdiop.dest);
+    fdiop = casycom_create_proxy (&i_FdIO, oid_App);
+    PFdIO_attach (&fdiop, app->pipefd[0]);
+    app->readerp = casycom_create_proxy_to (&i_IO, oid_App, fdiop.dest);
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+
+    vector_resize (&app->wbuf, BlockSize);
+    for (size_t i = 0; i < BlockSize; ++i)
+	app->wbuf.d[i] = i % 251;
+    PIO_write (&app->writerp, &app->wbuf);
+    for (unsigned i = 0; i < 2; ++i)
+	vector_reserve (&app->rbuf[i], ReadSize);
+    PIO_read (&app->readerp, &app->rbuf[0]);
+}
+
+static void App_IOR_read (App* app, CharVector* d)
+{
+    if (d) {
+	if (!d->size)
+	    return;
+	vector_append_n (&app->received, d->d, d->size);
+	vector_clear (d);
+	PIO_read (&app->readerp, &app->rbuf[++app->nreads % 2]);
+	App_check_done (app);
+    } else if (!app->eof) {	// Reported again for each later read
+	app->eof = true;
+	LOG ("Reader reported the end of file\n");
+	casycom_quit (EXIT_SUCCESS);
+    }
+}
+
+static void App_IOR_written (App* app, CharVector* d)
+{
+    if (d && !d->size) {
+	app->written = true;
+	App_check_done (app);
+    }
+}
+
+// Writes the next chunk
+static void App_PingR_ping (App* app, uint32_t n)
+{
+    char chunk [ChunkSize];
+    for (size_t i = 0; i < ChunkSize; ++i)
+	chunk[i] = (n*ChunkSize + i) % 251;
+    if (0 > write (app->pipefd[1], chunk, ChunkSize))
+	return casycom_error ("write: %s", strerror(errno));
+    app->nchunks = n+1;
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DIOR d_App_IOR = {
+    .interface = &i_IOR,
+    DMETHOD (App, IOR_read),
+    DMETHOD (App, IOR_written)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_IOR, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,112 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <sys/wait.h>
+
+//----------------------------------------------------------------------
+// Interface names are resolved through a hash of registered interfaces,
+// both by casycom_interface_by_name and for messages arriving through
+// an Extern connection. The Extern also caches the interface and method
+// of the last message received, for runs of messages to one method.
+//
+// Here the app looks up a few names, and then forks a server exporting
+// Ping. For each ping it creates a new remote object and deletes the
+// previous one, so that the server receives a mix of COM and Ping
+// messages, each to a method different from the one before it.
+
+enum { NPings = 3 };
+
+typedef struct _App {
+    Proxy	pingp;
+    Proxy	externp;
+    pid_t	server_pid;
+} App;
+
+static const iid_t eil_Ping[] = { &i_Ping, NULL };
+
+//----------------------------------------------------------------------
+
+static void App_lookup (const char* name)
+{
+    iid_t iid = casycom_interface_by_name (name);
+    LOG ("Interface %s is %s\n", name, iid ? "registered" : "not registered");
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App o = {}; return &o; }
+
+static void App_destroy (void* vapp)
+{
+    const App* app = vapp;
+    if (app->server_pid > 0)
+	waitpid (app->server_pid, NULL, 0);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_externs();
+    int socks[2];
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, socks))
+	return casycom_error ("socketpair: %s", strerror(errno));
+    int fr = fork();
+    if (fr < 0)
+	return casycom_error ("fork: %s", strerror(errno));
+    app->externp = casycom_create_proxy (&i_Extern, oid_App);
+    if (fr == 0) {	// Server side
+	close (socks[0]);
+	casycom_register (&f_Ping);
+	PExtern_open (&app->externp, socks[1], EXTERN_SERVER, NULL, eil_Ping);
+    } else {		// Client side
+	app->server_pid = fr;
+	close (socks[1]);
+	PExtern_open (&app->externp, socks[0], EXTERN_CLIENT, eil_Ping, NULL);
+    }
+}
+
+static void App_ExternR_connected (App* app, const ExternInfo* einfo)
+{
+    if (!app->server_pid)
+	return;	// log only the client side
+    LOG ("Connected to server. Imported %zu interface\n", einfo->interfaces.size);
+    // Only interfaces of local factories are registered. Ping objects
+    // are created by the default factory, which forwards to the Extern.
+    App_lookup ("Ping");
+    App_lookup ("PingR");
+    App_lookup ("Extern");
+    App_lookup ("Pin");
+    App_lookup ("PingRR");
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 1);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    LOG ("Ping %u reply received in app\n", u);
+    if (u >= NPings)
+	return casycom_quit (EXIT_SUCCESS);
+    casycom_destroy_proxy (&app->pingp);
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, u+1);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DExternR d_App_ExternR = {
+    .interface = &i_ExternR,
+    DMETHOD (App, ExternR_connected)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_ExternR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,73 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Small messages are allocated together with their bodies from size
+// class pools, and freed messages are cached for reuse. Once a steady
+// exchange of messages is going, no more are allocated with malloc.
+// casymsg_pool_stats reports the cache hits and misses of each class.
+//
+// Here the app pings a Ping object a number of times, one ping at a time,
+// and checks that all pings and replies after the first reused messages.
+
+enum { NPings = 10 };
+
+typedef struct _App {
+    Proxy		pingp;
+    MsgPoolStats	start [MESSAGE_POOL_CLASSES];
+} App;
+
+// Returns the pool class with inline space for a body of sz bytes
+static unsigned App_pool_class (const MsgPoolStats* stats, uint32_t sz)
+{
+    unsigned c = 1;
+    while (stats[c].bodysz < sz)
+	++c;
+    return c;
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Ping);
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 1);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    if (u == 1)	// The Ping object exists now, count from here
+	casymsg_pool_stats (app->start);
+    if (u < NPings)
+	return PPing_ping (&app->pingp, u+1);
+    MsgPoolStats end [MESSAGE_POOL_CLASSES];
+    casymsg_pool_stats (end);
+    const unsigned c = App_pool_class (end, sizeof(uint32_t));
+    LOG ("Ping messages use the %u byte class\n", end[c].bodysz);
+    LOG ("%u allocations, %u from malloc\n",
+	    (unsigned) (end[c].hits + end[c].misses - app->start[c].hits - app->start[c].misses),
+	    (unsigned) (end[c].misses - app->start[c].misses));
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
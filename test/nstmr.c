@@ -0,0 +1,75 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Timers are timed in nanoseconds on the monotonic clock, and can be
+// started with sub-millisecond timeouts with PTimer_timer_ns. PTimer_timer
+// still takes milliseconds. Timer_now_ns returns the clock they use.
+//
+// Here timers a fraction of a millisecond apart are started in scrambled
+// order. They fire in the order of their timeouts, and none fires early.
+
+enum {
+    NTimers = 5,
+    TimeoutStep = 300000	// ns
+};
+
+typedef struct _App {
+    Proxy	timerp [NTimers];
+    casytimer_t	start;
+    unsigned	nfired;
+} App;
+
+// Timer 0, started in milliseconds, has the longest timeout
+static const uint8_t c_order [NTimers] = { 3, 1, 2, 4, 0 };
+
+static casytimer_t App_timeout (unsigned i)
+    { return i ? i*TimeoutStep : 2*TIMER_NS_PER_MS; }
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    app->start = Timer_now_ns();
+    for (unsigned i = 0; i < NTimers; ++i) {
+	const unsigned n = c_order[i];
+	app->timerp[n] = casycom_create_proxy (&i_Timer, oid_App);
+	if (n)
+	    PTimer_timer_ns (&app->timerp[n], App_timeout (n));
+	else
+	    PTimer_timer (&app->timerp[n], 2);
+    }
+}
+
+static void App_TimerR_timer (App* app, int fd UNUSED, const Msg* msg)
+{
+    const casytimer_t elapsed = Timer_now_ns() - app->start;
+    unsigned n = 0;
+    while (n < NTimers && app->timerp[n].dest != msg->h.src)
+	++n;
+    LOG ("Timer %u fired %s\n", n, elapsed >= App_timeout (n) ? "on time" : "early");
+    if (++app->nfired == NTimers)
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DTimerR d_App_TimerR = {
+    .interface = &i_TimerR,
+    DMETHOD (App, TimerR_timer)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_TimerR, NULL }
+};
+CASYCOM_MAIN (f_App)
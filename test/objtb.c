@@ -0,0 +1,105 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// The link table is indexed by oid. This test creates a row of objects,
+// destroys every other one, and creates new ones in their place, checking
+// that each message still reaches the object it was sent to.
+
+enum { NCounters = 8, Round2 = 100 };
+
+typedef struct _App {
+    Proxy	pingp [NCounters];
+    unsigned	nreplies;
+} App;
+
+//----------------------------------------------------------------------
+// The Counter remembers the first ping it got, and replies with it
+
+typedef struct _Counter {
+    Proxy	reply;
+    uint32_t	id;
+} Counter;
+
+static void* Counter_create (const Msg* msg)
+{
+    Counter* o = xalloc (sizeof(Counter));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    return o;
+}
+
+static void Counter_destroy (void* vo)
+{
+    Counter* o = vo;
+    LOG ("Counter %u destroyed\n", o->id);
+    xfree (o);
+}
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    if (!o->id)
+	o->id = u;
+    PPingR_ping (&o->reply, o->id*1000 + u);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const Factory f_Counter = {
+    .create	= Counter_create,
+    .destroy	= Counter_destroy,
+    .dtable	= { &d_Counter_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Counter);
+    for (unsigned i = 0; i < NCounters; ++i) {
+	app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	PPing_ping (&app->pingp[i], i+1);
+    }
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    LOG ("Ping %u reply from counter %u\n", u%1000, u/1000);
+    if (++app->nreplies == NCounters) {
+	// Replace every other counter, and ping all of them again
+	for (unsigned i = 0; i < NCounters; i += 2) {
+	    casycom_destroy_proxy (&app->pingp[i]);
+	    app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	}
+	for (unsigned i = 0; i < NCounters; ++i)
+	    PPing_ping (&app->pingp[i], Round2+i+1);
+    } else if (app->nreplies == 2*NCounters) {
+	for (unsigned i = 0; i < NCounters; ++i)
+	    casycom_destroy_proxy (&app->pingp[i]);
+	casycom_quit (EXIT_SUCCESS);
+    }
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,107 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Object ids are reused after enough of them have been freed. Each oid
+// slot has a generation counter, copied into proxies and messages, so
+// that a message queued for a destroyed object is dropped instead of
+// being delivered to the new object using the same oid. This test
+// destroys an object with a message still queued for it, reuses its
+// oid, and checks that only the new object's message is delivered.
+
+typedef struct _App {
+    Proxy	pingp;
+    Proxy	stalep;
+} App;
+
+// The Ping server here logs its oid, to show that it is reused
+typedef struct _Counter {
+    Proxy	reply;
+} Counter;
+
+static void* Counter_create (const Msg* msg)
+{
+    Counter* o = xalloc (sizeof(Counter));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    LOG ("Created Counter %u\n", msg->h.dest);
+    return o;
+}
+static void Counter_destroy (void* o)
+    { xfree (o); }
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    LOG ("Counter %u received ping %u\n", casycom_oid_of_object (o), u);
+    PPingR_ping (&o->reply, u);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const Factory f_Counter = {
+    .create	= Counter_create,
+    .destroy	= Counter_destroy,
+    .dtable	= { &d_Counter_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+// Enough to exceed the delay before freed oids are reused
+enum { NFillerOids = 64 };
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Counter);
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 1);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    LOG ("Ping %u reply received in app\n", u);
+    if (u != 1) {
+	// The new object has the old oid, but a different generation
+	LOG ("Ping %u sent to oid %s, generation %s\n", u,
+		app->pingp.dest == app->stalep.dest ? "reused" : "not reused",
+		app->pingp.gen != app->stalep.gen ? "changed" : "unchanged");
+	return casycom_quit (EXIT_SUCCESS);
+    }
+    // Queue a message for the object, and then destroy it by destroying
+    // the proxy that created it. The message stays in the queue.
+    app->stalep = app->pingp;
+    PPing_ping (&app->pingp, 2);
+    casycom_destroy_proxy (&app->pingp);
+    // Free more oids, so that the next one allocated reuses the first
+    for (unsigned i = 0; i < NFillerOids; ++i) {
+	Proxy fp = casycom_create_proxy (&i_Ping, oid_App);
+	casycom_destroy_proxy (&fp);
+    }
+    // The new object gets the oid of the destroyed one. Ping 2 is
+    // still queued for that oid, but is dropped, never reaching it.
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 3);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
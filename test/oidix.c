@@ -0,0 +1,107 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// casycom_oid_of_object and casycom_mark_unused find the object's oid
+// from its pointer, through a hash index. This test creates a number of
+// objects, checks that each finds its own oid, and then has half of
+// them mark themselves unused, checking that exactly those are destroyed.
+
+enum { NCounters = 16, MarkUnused = 1000 };
+
+typedef struct _App {
+    Proxy	pingp [NCounters];
+    unsigned	nreplies;
+} App;
+
+//----------------------------------------------------------------------
+
+typedef struct _Counter {
+    Proxy	reply;
+    oid_t	oid;
+    uint32_t	id;
+} Counter;
+
+static void* Counter_create (const Msg* msg)
+{
+    Counter* o = xalloc (sizeof(Counter));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    o->oid = msg->h.dest;
+    return o;
+}
+
+static void Counter_destroy (void* vo)
+{
+    Counter* o = vo;
+    LOG ("Counter %u destroyed\n", o->id);
+    xfree (o);
+}
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    if (u < MarkUnused) {
+	o->id = u;
+	if (casycom_oid_of_object (o) != o->oid)
+	    LOG ("Counter %u has the wrong oid\n", o->id);
+    } else if (o->id % 2)
+	casycom_mark_unused (o);
+    PPingR_ping (&o->reply, u);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const Factory f_Counter = {
+    .create	= Counter_create,
+    .destroy	= Counter_destroy,
+    .dtable	= { &d_Counter_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Counter);
+    for (unsigned i = 0; i < NCounters; ++i) {
+	app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	PPing_ping (&app->pingp[i], i+1);
+    }
+}
+
+static void App_PingR_ping (App* app, uint32_t u UNUSED)
+{
+    if (++app->nreplies == NCounters) {
+	LOG ("%u counters found their oids\n", NCounters);
+	for (unsigned i = 0; i < NCounters; ++i)
+	    PPing_ping (&app->pingp[i], MarkUnused);
+    } else if (app->nreplies == 2*NCounters) {
+	LOG ("Destroying the rest\n");
+	for (unsigned i = 0; i < NCounters; ++i)
+	    casycom_destroy_proxy (&app->pingp[i]);
+	casycom_quit (EXIT_SUCCESS);
+    }
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
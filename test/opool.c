@@ -0,0 +1,112 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+
+//----------------------------------------------------------------------
+// Factories that set object_size have their objects allocated from a
+// per-factory pool, zeroed, and passed to init. After destroy, the
+// memory goes back to the pool, for the next object of the factory.
+//
+// Here the app creates some objects, destroys half of them, and then
+// creates as many again, checking that the new ones reuse the memory
+// of the destroyed ones, and that it is zeroed.
+
+enum { NCounters = 4 };
+
+typedef struct _App {
+    Proxy	pingp [NCounters];
+    unsigned	nreplies;
+} App;
+
+//----------------------------------------------------------------------
+
+typedef struct _Counter {
+    Proxy	reply;
+    uint32_t	id;
+} Counter;
+
+static const void* _freed [NCounters] = {};
+static unsigned _nfreed = 0;
+
+static void Counter_init (void* vo, const Msg* msg)
+{
+    Counter* o = vo;
+    bool zeroed = true, reused = false;
+    for (size_t i = 0; i < sizeof(*o); ++i)
+	zeroed &= !((const char*)o)[i];
+    for (unsigned i = 0; i < _nfreed; ++i)
+	reused |= (_freed[i] == o);
+    LOG ("Counter created %s, in %s memory\n", zeroed ? "zeroed" : "not zeroed", reused ? "reused" : "new");
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+}
+
+static void Counter_destroy (void* vo)
+{
+    Counter* o = vo;
+    LOG ("Counter %u destroyed\n", o->id);
+    _freed[_nfreed++] = o;
+}
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    o->id = u;
+    PPingR_ping (&o->reply, u);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const Factory f_Counter = {
+    .init	= Counter_init,
+    .destroy	= Counter_destroy,
+    .object_size = sizeof(Counter),
+    .dtable	= { &d_Counter_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Counter);
+    for (unsigned i = 0; i < NCounters; ++i) {
+	app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	PPing_ping (&app->pingp[i], i+1);
+    }
+}
+
+static void App_PingR_ping (App* app, uint32_t u UNUSED)
+{
+    if (++app->nreplies == NCounters) {
+	for (unsigned i = 0; i < NCounters; i += 2) {
+	    casycom_destroy_proxy (&app->pingp[i]);
+	    app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+	    PPing_ping (&app->pingp[i], NCounters+i+1);
+	}
+    } else if (app->nreplies == NCounters + NCounters/2) {
+	_nfreed = 0;	// Destroyed at exit
+	casycom_quit (EXIT_SUCCESS);
+    }
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,122 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <fcntl.h>
+
+//----------------------------------------------------------------------
+// A persistent watch keeps firing until stopped, instead of once. For a
+// timeout, that makes a periodic timer. For an fd, it fires each time
+// the fd is ready, and the Timer object is not recreated for each wait.
+//
+// Here a periodic timer and a persistent read watch on a pipe are each
+// stopped after firing a few times. The app writes a byte to the pipe
+// and reads it back on each fire. A last timer then checks that neither
+// fired again after being stopped. The watch must fire once per byte,
+// never finding the pipe empty, while the app also sends a message to
+// itself in every pass, so there is always one waiting for it.
+
+enum {
+    NFires = 3,
+    Period = 5,		// ms
+    SettleTimeout = 30
+};
+
+typedef struct _App {
+    Proxy	periodicp;
+    Proxy	watchp;
+    Proxy	settlep;
+    Proxy	selfp;
+    int		pipefd [2];
+    unsigned	nperiodic;
+    unsigned	nread;
+    unsigned	nempty;
+    unsigned	nstopped;
+} App;
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+
+static void App_destroy (void* vapp)
+{
+    App* app = vapp;
+    close (app->pipefd[0]);
+    close (app->pipefd[1]);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    if (0 > pipe2 (app->pipefd, O_NONBLOCK))
+	return casycom_error ("pipe2: %s", strerror(errno));
+    app->periodicp = casycom_create_proxy (&i_Timer, oid_App);
+    app->watchp = casycom_create_proxy (&i_Timer, oid_App);
+    app->settlep = casycom_create_proxy (&i_Timer, oid_App);
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+    PPingR_ping (&app->selfp, 0);
+    PTimer_periodic (&app->periodicp, Period);
+    PTimer_watch_read (&app->watchp, app->pipefd[0]);
+    if (0 > write (app->pipefd[1], "x", 1))
+	return casycom_error ("write: %s", strerror(errno));
+}
+
+static void App_stopped (App* app)
+{
+    if (++app->nstopped == 2)
+	PTimer_timer (&app->settlep, SettleTimeout);
+}
+
+static void App_TimerR_timer (App* app, int fd UNUSED, const Msg* msg)
+{
+    if (msg->h.src == app->periodicp.dest) {
+	if (++app->nperiodic == NFires) {
+	    PTimer_stop (&app->periodicp);
+	    App_stopped (app);
+	}
+    } else if (msg->h.src == app->watchp.dest) {
+	char c;
+	if (0 > read (app->pipefd[0], &c, 1)) {
+	    if (errno != EAGAIN)
+		casycom_error ("read: %s", strerror(errno));
+	    ++app->nempty;
+	    return;
+	}
+	if (++app->nread == NFires) {
+	    PTimer_stop (&app->watchp);
+	    App_stopped (app);
+	} else if (0 > write (app->pipefd[1], "x", 1))
+	    return casycom_error ("write: %s", strerror(errno));
+    } else {
+	LOG ("Periodic timer fired %u times\n", app->nperiodic);
+	LOG ("Pipe watch read %u bytes, one per write, and found it empty %u times\n", app->nread, app->nempty);
+	casycom_quit (EXIT_SUCCESS);
+    }
+}
+
+// Keeps a message queued to the app until the pipe watch is stopped
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    if (app->nread < NFires)
+	PPingR_ping (&app->selfp, u+1);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DTimerR d_App_TimerR = {
+    .interface = &i_TimerR,
+    DMETHOD (App, TimerR_timer)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_TimerR, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -47,7 +47,7 @@ typedef struct _DPingR {
     const Interface*	interface;
     MFN_PingR_ping	PingR_ping;
 } DPingR;
-void PPingR_Ping (const Proxy* pp, uint32_t v);
+void PPingR_ping (const Proxy* pp, uint32_t v);
 
 extern const Interface i_PingR;
 
@@ -0,0 +1,139 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <sys/wait.h>
+
+//----------------------------------------------------------------------
+// Messages to remote objects are handed by the COM relay of each object
+// straight to the Extern, without waiting for a pass of the loop. They
+// must still be sent in the order they were queued, whichever remote
+// object they are for, and even when some must wait in the queue.
+//
+// Here the app forks a server, as in ipcom, and sends pings alternately
+// to two remote objects. Each remote object takes its first ping as its
+// id, and replies with both, so the app can check that the replies come
+// back in the order the pings were sent, each from the right object.
+
+enum { NObjects = 2, NPings = 40, IdMul = 10000 };
+
+typedef struct _App {
+    Proxy	pingp [NObjects];
+    Proxy	externp;
+    pid_t	server_pid;
+    unsigned	nreplies;
+    unsigned	ninorder;
+} App;
+
+static const iid_t eil_Ping[] = { &i_Ping, NULL };
+
+//----------------------------------------------------------------------
+// Remembers the first ping as its id
+
+typedef struct _Counter {
+    Proxy	reply;
+    uint32_t	id;
+} Counter;
+
+static void* Counter_create (const Msg* msg)
+{
+    Counter* o = xalloc (sizeof(Counter));
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    return o;
+}
+
+static void Counter_destroy (void* o)
+    { xfree (o); }
+
+static void Counter_Ping_ping (Counter* o, uint32_t u)
+{
+    if (!o->id)
+	o->id = u;
+    PPingR_ping (&o->reply, o->id*IdMul + u);
+}
+
+static const DPing d_Counter_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Counter, Ping_ping)
+};
+static const Factory f_Counter = {
+    .create	= Counter_create,
+    .destroy	= Counter_destroy,
+    .dtable	= { &d_Counter_Ping, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App o = {}; return &o; }
+
+static void App_destroy (void* vapp)
+{
+    const App* app = vapp;
+    if (app->server_pid > 0)
+	waitpid (app->server_pid, NULL, 0);
+}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_externs();
+    int socks[2];
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, socks))
+	return casycom_error ("socketpair: %s", strerror(errno));
+    int fr = fork();
+    if (fr < 0)
+	return casycom_error ("fork: %s", strerror(errno));
+    app->externp = casycom_create_proxy (&i_Extern, oid_App);
+    if (fr == 0) {	// Server side
+	close (socks[0]);
+	casycom_register (&f_Counter);
+	PExtern_open (&app->externp, socks[1], EXTERN_SERVER, NULL, eil_Ping);
+    } else {		// Client side
+	app->server_pid = fr;
+	close (socks[1]);
+	PExtern_open (&app->externp, socks[0], EXTERN_CLIENT, eil_Ping, NULL);
+    }
+}
+
+static void App_ExternR_connected (App* app, const ExternInfo* einfo UNUSED)
+{
+    if (!app->server_pid)
+	return;
+    for (unsigned i = 0; i < NObjects; ++i)
+	app->pingp[i] = casycom_create_proxy (&i_Ping, oid_App);
+    for (unsigned k = 1; k <= NPings; ++k)
+	PPing_ping (&app->pingp[(k-1) % NObjects], k);
+}
+
+// Ping k is sent to object (k-1)%NObjects, whose id is its first ping
+static void App_PingR_ping (App* app, uint32_t v)
+{
+    const uint32_t k = v % IdMul, id = v / IdMul;
+    if (k == app->nreplies+1 && id == (k-1) % NObjects + 1)
+	++app->ninorder;
+    if (++app->nreplies < NPings)
+	return;
+    LOG ("%u of %u replies in the order sent, each from the right object\n", app->ninorder, NPings);
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DExternR d_App_ExternR = {
+    .interface = &i_ExternR,
+    DMETHOD (App, ExternR_connected)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_ExternR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,61 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include "../timer.h"
+
+//----------------------------------------------------------------------
+// Timeouts not needing an object can be started with Timer_timeout_start,
+// which calls the given function on the loop thread when the timeout
+// expires. The returned handle can be used to cancel it before then.
+//
+// Here the timeouts are started in scrambled order, and fire in the
+// order of their deadlines. One of them is cancelled and never fires.
+
+enum {
+    NTimeouts = 8,
+    TimeoutStep = 10*TIMER_NS_PER_MS,
+    CancelledTimeout = 3
+};
+
+typedef struct _App {
+    casytimeout_t	timeouts [NTimeouts+1];
+} App;
+
+static void App_timeout (void* arg)
+{
+    unsigned n = (uintptr_t) arg;
+    LOG ("Timeout %u fired\n", n);
+    if (n == NTimeouts)
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    static const uint8_t c_order [NTimeouts] = { 5, 2, 7, 1, 8, 3, 6, 4 };
+    for (unsigned i = 0; i < NTimeouts; ++i) {
+	const unsigned n = c_order[i];
+	LOG ("Starting timeout %u\n", n);
+	app->timeouts[n] = Timer_timeout_start (n*TimeoutStep, App_timeout, (void*)(uintptr_t) n);
+    }
+    LOG ("Cancelling timeout %u: %s\n", CancelledTimeout, Timer_timeout_cancel (app->timeouts[CancelledTimeout]) ? "cancelled" : "already fired");
+    // The handle is no longer valid, even if its slot is reused
+    LOG ("Cancelling timeout %u again: %s\n", CancelledTimeout, Timer_timeout_cancel (app->timeouts[CancelledTimeout]) ? "cancelled" : "not found");
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,85 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <pthread.h>
+#include <poll.h>
+
+//----------------------------------------------------------------------
+// Messages may be sent to objects from other threads. They are queued
+// without a lock, and the loop is woken up to deliver them, even when
+// it is blocked waiting for an fd or a timer.
+//
+// Here the app waits for a pipe, and starts a thread that sends it a
+// message. The thread writes to the pipe only much later, so that the
+// loop, if not woken by the message, gets it only after that write.
+
+enum { LateWriteDelay = 2 };	// seconds
+
+typedef struct _App {
+    Proxy	timerp;
+    Proxy	selfp;
+    pthread_t	thread;
+    int		pipefd [2];
+} App;
+
+static void* Sender_thread (void* vapp)
+{
+    App* app = vapp;
+    usleep (10000);
+    PPingR_ping (&app->selfp, 1);
+    sleep (LateWriteDelay);
+    if (0 > write (app->pipefd[1], "x", 1))
+	return NULL;
+    return NULL;
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_register (&f_Timer);
+    if (0 > pipe (app->pipefd))
+	return casycom_error ("pipe: %s", strerror(errno));
+    app->timerp = casycom_create_proxy (&i_Timer, oid_App);
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+    PTimer_wait_read (&app->timerp, app->pipefd[0]);
+    if (0 != pthread_create (&app->thread, NULL, Sender_thread, app))
+	return casycom_error ("pthread_create failed");
+    pthread_detach (app->thread);
+}
+
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    struct pollfd pfd = { .fd = app->pipefd[0], .events = POLLIN };
+    LOG ("Received ping %u from the thread %s\n", u, poll (&pfd, 1, 0) ? "after the pipe became readable" : "while waiting for the pipe");
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static void App_TimerR_timer (App* app UNUSED, int fd UNUSED, const Msg* msg UNUSED)
+{
+    LOG ("The pipe became readable before the ping was received\n");
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DTimerR d_App_TimerR = {
+    .interface = &i_TimerR,
+    DMETHOD (App, TimerR_timer)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_TimerR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -0,0 +1,80 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include "../work.h"
+#include <pthread.h>
+
+//----------------------------------------------------------------------
+// Blocking or long computations can be run on the work pool, so that
+// the message loop is not held up. PWork_run calls the given function
+// on a pool thread, and replies with WorkR_done when it returns. The
+// argument is passed back in the reply, and can hold the result.
+
+typedef struct _Job {
+    unsigned	n;
+    unsigned	sum;
+    bool	on_loop_thread;
+} Job;
+
+enum { NJobs = 2 };
+
+typedef struct _App {
+    Proxy	workp [NJobs];
+    Job		jobs [NJobs];
+    unsigned	ndone;
+} App;
+
+static pthread_t _loop_thread;
+
+// Runs on a pool thread, and must not use casycom objects
+static void sum_to_n (void* vjob)
+{
+    Job* j = vjob;
+    j->on_loop_thread = pthread_equal (pthread_self(), _loop_thread);
+    for (unsigned i = 1; i <= j->n; ++i)
+	j->sum += i;
+}
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    _loop_thread = pthread_self();
+    casycom_register (&f_Work);
+    // Each Work object replies to its creator, and can run many jobs
+    for (unsigned i = 0; i < NJobs; ++i) {
+	app->jobs[i].n = 100*(i+1);
+	app->workp[i] = casycom_create_proxy (&i_Work, oid_App);
+	PWork_run (&app->workp[i], sum_to_n, &app->jobs[i]);
+    }
+}
+
+// The replies are delivered on the loop thread, in completion order
+static void App_WorkR_done (App* app, void* arg UNUSED)
+{
+    if (++app->ndone < NJobs)
+	return;
+    for (unsigned i = 0; i < NJobs; ++i)
+	LOG ("Sum to %u is %u, computed on %s\n", app->jobs[i].n, app->jobs[i].sum, app->jobs[i].on_loop_thread ? "the loop thread" : "a pool thread");
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DWorkR d_App_WorkR = {
+    .interface = &i_WorkR,
+    DMETHOD (App, WorkR_done)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_WorkR, NULL }
+};
+CASYCOM_MAIN (f_App)
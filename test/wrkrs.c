@@ -0,0 +1,112 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <pthread.h>
+
+//----------------------------------------------------------------------
+// Objects of factories registered with casycom_register_threaded have
+// their messages delivered on worker threads, started with
+// casycom_enable_workers. The loop thread still routes all messages,
+// creates and destroys objects. An object created by a threaded object
+// is pinned to its creator's worker, so both always run on one thread.
+//
+// Here the app pings a threaded Node, which creates a child Node and
+// passes the ping on to it. The child replies to its parent, which
+// replies to the app.
+
+typedef struct _App {
+    Proxy	pingp;
+} App;
+
+static pthread_t _loop_thread;
+static pthread_t _parent_thread;
+
+//----------------------------------------------------------------------
+// Node serves Ping, and receives its child's replies with PingR
+
+typedef struct _Node {
+    Proxy	reply;
+    Proxy	childp;
+} Node;
+
+static void Node_init (void* vo, const Msg* msg)
+{
+    Node* o = vo;
+    // Objects and proxies are created on the loop thread. The child
+    // object is only created if a message is sent to it.
+    o->reply = casycom_create_reply_proxy (&i_PingR, msg);
+    o->childp = casycom_create_proxy (&i_Ping, msg->h.dest);
+}
+
+static void Node_Ping_ping (Node* o, uint32_t u)
+{
+    if (u == 1) {	// The parent, pinged by the app
+	_parent_thread = pthread_self();
+	LOG ("Parent received ping %u on %s\n", u, pthread_equal (_parent_thread, _loop_thread) ? "the loop thread" : "a worker thread");
+	// Messages can be sent from the worker through existing proxies
+	PPing_ping (&o->childp, u+1);
+    } else {		// The child
+	LOG ("Child received ping %u on %s\n", u, pthread_equal (pthread_self(), _parent_thread) ? "its parent's worker" : "another thread");
+	PPingR_ping (&o->reply, u);
+    }
+}
+
+static void Node_PingR_ping (Node* o, uint32_t u)
+{
+    LOG ("Parent received child reply %u on %s\n", u, pthread_equal (pthread_self(), _parent_thread) ? "the same worker" : "another thread");
+    PPingR_ping (&o->reply, u);
+}
+
+static const DPing d_Node_Ping = {
+    .interface = &i_Ping,
+    DMETHOD (Node, Ping_ping)
+};
+static const DPingR d_Node_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (Node, PingR_ping)
+};
+static const Factory f_Node = {
+    .init	= Node_init,
+    .object_size = sizeof(Node),
+    .dtable	= { &d_Node_Ping, &d_Node_PingR, NULL }
+};
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App app = {}; return &app; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    _loop_thread = pthread_self();
+    // More than one worker, so the child could run on another one
+    casycom_enable_workers (4);
+    casycom_register_threaded (&f_Node);
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    PPing_ping (&app->pingp, 1);
+}
+
+static void App_PingR_ping (App* app UNUSED, uint32_t u)
+{
+    LOG ("Ping %u reply received in app on %s\n", u, pthread_equal (pthread_self(), _loop_thread) ? "the loop thread" : "a worker thread");
+    casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, NULL }
+};
+CASYCOM_MAIN (f_App)
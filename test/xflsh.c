@@ -0,0 +1,91 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "ping.h"
+#include <sys/ioctl.h>
+
+//----------------------------------------------------------------------
+// Messages to remote objects, handed by the COM relay straight to the
+// Extern, are written to the socket in the next pass of the loop, like
+// messages to local objects are delivered.
+//
+// Here both ends of a socket pair are opened by Externs in this process.
+// The ping proxy is created before f_Ping is registered, so its messages
+// go through the client Extern, and are received by the server Extern,
+// which creates the Ping object. After the first reply, the app sends
+// the second ping together with a message to itself, delivered in the
+// next pass, and checks that the ping is waiting on the server socket.
+
+typedef struct _App {
+    Proxy	pingp;
+    Proxy	selfp;
+    Proxy	externp [2];
+    int		socks [2];
+} App;
+
+static const iid_t eil_Ping[] = { &i_Ping, NULL };
+
+//----------------------------------------------------------------------
+
+static void* App_create (const Msg* msg UNUSED)
+    { static App o = {}; return &o; }
+static void App_destroy (void* o UNUSED) {}
+
+static void App_App_init (App* app, argc_t argc UNUSED, argv_t argv UNUSED)
+{
+    casycom_enable_externs();
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, app->socks))
+	return casycom_error ("socketpair: %s", strerror(errno));
+    app->pingp = casycom_create_proxy (&i_Ping, oid_App);
+    app->selfp = casycom_create_proxy_to (&i_PingR, oid_App, oid_App);
+    casycom_register (&f_Ping);
+    for (unsigned i = 0; i < 2; ++i)
+	app->externp[i] = casycom_create_proxy (&i_Extern, oid_App);
+    PExtern_open (&app->externp[0], app->socks[0], EXTERN_CLIENT, eil_Ping, NULL);
+    PExtern_open (&app->externp[1], app->socks[1], EXTERN_SERVER, NULL, eil_Ping);
+}
+
+static void App_ExternR_connected (App* app, const ExternInfo* einfo)
+{
+    if (einfo->is_client)
+	PPing_ping (&app->pingp, 1);
+}
+
+// Ping replies are nonzero; 0 is sent to itself
+static void App_PingR_ping (App* app, uint32_t u)
+{
+    if (!u) {
+	int nbytes = 0;
+	if (0 > ioctl (app->socks[1], FIONREAD, &nbytes))
+	    return casycom_error ("ioctl(FIONREAD): %s", strerror(errno));
+	LOG ("Ping 2 %s\n", nbytes > 0 ? "was written in the next pass" : "is not yet written");
+	return;
+    }
+    LOG ("Ping %u reply received in app\n", u);
+    if (u == 1) {
+	PPing_ping (&app->pingp, 2);
+	PPingR_ping (&app->selfp, 0);
+    } else
+	casycom_quit (EXIT_SUCCESS);
+}
+
+static const DApp d_App_App = {
+    .interface = &i_App,
+    DMETHOD (App, App_init)
+};
+static const DPingR d_App_PingR = {
+    .interface = &i_PingR,
+    DMETHOD (App, PingR_ping)
+};
+static const DExternR d_App_ExternR = {
+    .interface = &i_ExternR,
+    DMETHOD (App, ExternR_connected)
+};
+static const Factory f_App = {
+    .create	= App_create,
+    .destroy	= App_destroy,
+    .dtable	= { &d_App_App, &d_App_PingR, &d_App_ExternR, NULL }
+};
+CASYCOM_MAIN (f_App)
@@ -6,21 +6,40 @@
 #include "timer.h"
 #include "main.h"
 #include "vector.h"
+#include <sys/epoll.h>
+#include <sys/syscall.h>
 #include <time.h>
+#ifdef __NR_epoll_pwait2
+    #include <linux/time_types.h>
+#endif
+#if USE_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/uio.h>
+#endif
 
 //----------------------------------------------------------------------
 // Timer interface
 
-enum { method_Timer_watch };
+enum { method_Timer_watch, method_Timer_set_slack };
 
-void PTimer_watch (const Proxy* pp, enum ETimerWatchCmd cmd, int fd, casytimer_t timeoutms)
+void PTimer_watch_ns (const Proxy* pp, enum ETimerWatchCmd cmd, int fd, casytimer_t timeout)
 {
     assert (pp->interface == &i_Timer && "the given proxy is for a different interface");
     Msg* msg = casymsg_begin (pp, method_Timer_watch, 16);
     WStm os = casymsg_write (msg);
     casystm_write_uint32 (&os, cmd);
     casystm_write_int32 (&os, fd);
-    casystm_write_uint64 (&os, timeoutms);
+    casystm_write_uint64 (&os, timeout);
+    casymsg_end (msg);
+}
+
+void PTimer_set_slack (const Proxy* pp, casytimer_t slack)
+{
+    assert (pp->interface == &i_Timer && "the given proxy is for a different interface");
+    Msg* msg = casymsg_begin (pp, method_Timer_set_slack, 8);
+    WStm os = casymsg_write (msg);
+    casystm_write_uint64 (&os, slack);
     casymsg_end (msg);
 }
 
@@ -30,8 +49,12 @@ static void Timer_dispatch (const DTimer* dtable, void* o, const Msg* msg)
 	RStm is = casymsg_read (msg);
 	enum ETimerWatchCmd cmd = casystm_read_uint32 (&is);
 	int fd = casystm_read_int32 (&is);
-	casytimer_t timeoutms = casystm_read_uint64 (&is);
-	dtable->Timer_watch (o, cmd, fd, timeoutms);
+	casytimer_t timeout = casystm_read_uint64 (&is);
+	dtable->Timer_watch (o, cmd, fd, timeout);
+    } else if (msg->imethod == method_Timer_set_slack) {
+	RStm is = casymsg_read (msg);
+	casytimer_t slack = casystm_read_uint64 (&is);
+	dtable->Timer_set_slack (o, slack);
     } else
 	casymsg_default_dispatch (dtable, o, msg);
 }
@@ -39,7 +62,7 @@ static void Timer_dispatch (const DTimer* dtable, void* o, const Msg* msg)
 const Interface i_Timer = {
     .name	= "Timer",
     .dispatch	= Timer_dispatch,
-    .method	= { "watch\0uix", NULL }
+    .method	= { "watch\0uix", "set_slack\0x", NULL }
 };
 
 //----------------------------------------------------------------------
@@ -79,155 +102,852 @@ typedef struct _Timer {
     casytimer_t		nextfire;
     enum ETimerWatchCmd	cmd;
     int			fd;
+    struct _Timer*	nextonfd;	// Next timer watching the same fd
+    casytimer_t		period;		// Of a persistent timeout
+    casytimer_t		slack;		// The timeout may fire this much later
+    uint32_t		iwatch;		// Index in the watch list
+    uint32_t		iheap;		// ... and in the timeout heap
+    bool		fired;		// Persistent fd watch replied
+    uint32_t		replyn;		// ... with the owner's nth queued message
 } Timer;
 
-// Global list of pointers to active timer objects
 DECLARE_VECTOR_TYPE (WatchList, Timer*);
-static VECTOR(WatchList, _timer_watch_list);
+
+// Pending timeouts are kept in a 4-ary min-heap on the firing time,
+// shallower than a binary heap and scanning adjacent children. Each
+// node is either a Timer object or a timeout handle.
+typedef struct _TimeoutNode {
+    casytimer_t	at;
+    Timer*	t;	// NULL for a timeout handle
+    uint32_t	ih;	// ... index of the handle
+} TimeoutNode;
+
+DECLARE_VECTOR_TYPE (TimeoutHeap, TimeoutNode);
+
+typedef struct _TimeoutHandle {
+    pfn_timeout	fn;	// NULL when unused
+    void*	arg;
+    uint32_t	iheap;	// Index in the heap, or the next free handle
+    uint32_t	gen;	// Distinguishes reuses of the same handle
+} TimeoutHandle;
+
+DECLARE_VECTOR_TYPE (TimeoutHandleList, TimeoutHandle);
+
+// Timers watching an fd, and the events registered with epoll for it
+typedef struct _FdWatch {
+    Timer*	first;
+    uint32_t	events;
+    bool	alwaysready;	// Not pollable, so not in the epoll set
+} FdWatch;
+
+DECLARE_VECTOR_TYPE (FdWatchList, FdWatch);
+DECLARE_VECTOR_TYPE (FdList, int);
+
+#if USE_IO_URING
+enum {
+    URING_ENTRIES = 256,
+    URING_NBUFS = 64,		// One per op in flight
+    URING_BUFSZ = 16*1024
+};
+
+typedef struct _UringOp {
+    void*		o;	// NULL when cancelled
+    pfn_uring_done	done;
+    bool		busy;
+} UringOp;
+
+// The submission and completion rings shared with the kernel, and the
+// buffers transferred through them. The buffers are owned by the ring,
+// so an op outliving its object never touches freed memory.
+typedef struct _Uring {
+    int			fd;
+    bool		fixed;		// bufs are registered with the kernel
+    unsigned		inflight;	// ops not yet completed
+    unsigned		nsubmit;	// sqes not yet submitted
+    unsigned		sqentries;
+    unsigned*		sqhead;
+    unsigned*		sqtail;
+    unsigned*		sqmask;
+    unsigned*		sqarray;
+    unsigned*		cqhead;
+    unsigned*		cqtail;
+    unsigned*		cqmask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void*		ring;
+    size_t		ringsz;
+    size_t		sqesz;
+    char*		bufs;
+    UringOp		ops [URING_NBUFS];
+} Uring;
+#endif
+
+// Each casycom context has its own timer state, allocated with the first
+// timer and kept, with the epoll fd and the io_uring, until casycom_reset.
+// Watched fds are registered with epoll when the watch is set, so each
+// wait only returns the ready ones.
+typedef struct _TimerState {
+    WatchList	watch_list;	// All timer objects
+    TimeoutHeap	timeouts;
+    TimeoutHandleList	handles;
+    uint32_t	freehandle;	// Index+1 of the first unused handle
+    uint32_t	nhandles;	// Handles pending
+    FdWatchList	fds;		// Indexed by fd
+    FdList	readyfds;	// Watched fds epoll rejects, always ready
+    size_t	nfds;		// Number of fds watched
+    int		epfd;
+    casytimer_t	now;		// Updated after each wait
+    bool	nopwait2;	// The kernel can only wait for milliseconds
+#if USE_IO_URING
+    Uring*	ring;		// Created with the first io op
+    bool	noring;		// ... unless the kernel does not support it
+#endif
+} TimerState;
+
+enum { TIMER_MAX_EVENTS = 64 };	// Returned by one epoll_wait
+
+// Handle generations are unique across states, so a stale handle
+// never cancels a timeout in a later one.
+static _Atomic(uint32_t) _timer_handle_gen = 0;
+
+static inline TimerState* Timer_state (void)
+    { return *casycom_context_slot (CASYCOM_CONTEXT_TIMER); }
+
+//----------------------------------------------------------------------
+
+static TimerState* Timer_state_create (void)
+{
+    TimerState* ts = xalloc (sizeof(TimerState));
+    VECTOR_MEMBER_INIT (WatchList, ts->watch_list);
+    VECTOR_MEMBER_INIT (TimeoutHeap, ts->timeouts);
+    VECTOR_MEMBER_INIT (TimeoutHandleList, ts->handles);
+    VECTOR_MEMBER_INIT (FdWatchList, ts->fds);
+    VECTOR_MEMBER_INIT (FdList, ts->readyfds);
+    ts->now = Timer_now_ns();
+    if (0 > (ts->epfd = epoll_create1 (EPOLL_CLOEXEC))) {
+	casycom_log (LOG_ERR, "epoll_create1: %s\n", strerror(errno));
+	exit (EXIT_FAILURE);
+    }
+    const int wakeupfd = casycom_wakeup_fd();
+    if (wakeupfd >= 0) {
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = wakeupfd };
+	epoll_ctl (ts->epfd, EPOLL_CTL_ADD, wakeupfd, &ev);
+    }
+    return ts;
+}
+
+#if USE_IO_URING
+static void Timer_uring_free (Uring** pr);
+static inline unsigned Timer_uring_inflight (const TimerState* ts)
+    { return ts->ring ? ts->ring->inflight : 0; }
+#else
+static inline unsigned Timer_uring_inflight (const TimerState* ts UNUSED)
+    { return 0; }
+#endif
+
+static inline bool Timer_have_waits (const TimerState* ts)
+    { return ts->watch_list.size || ts->nhandles || Timer_uring_inflight (ts); }
+
+static void Timer_state_free (TimerState** pts)
+{
+    TimerState* ts = *pts;
+#if USE_IO_URING
+    if (ts->ring)
+	Timer_uring_free (&ts->ring);
+#endif
+    close (ts->epfd);
+    vector_deallocate (&ts->watch_list);
+    vector_deallocate (&ts->timeouts);
+    vector_deallocate (&ts->handles);
+    vector_deallocate (&ts->fds);
+    vector_deallocate (&ts->readyfds);
+    xfree (*pts);
+}
+
+static TimerState* Timer_state_get (void)
+{
+    TimerState** pts = (TimerState**) casycom_context_slot (CASYCOM_CONTEXT_TIMER);
+    if (!*pts)
+	*pts = Timer_state_create();
+    return *pts;
+}
+
+// This is privately exported to main.c . Do not use directly.
+/// Frees the timer state of the current context, when it is reset
+void Timer_state_reset (void)
+{
+    TimerState** pts = (TimerState**) casycom_context_slot (CASYCOM_CONTEXT_TIMER);
+    if (*pts)
+	Timer_state_free (pts);
+}
+
+//----------------------------------------------------------------------
+// The timeout heap
+
+static void Timer_heap_set (TimerState* ts, size_t i, TimeoutNode n)
+{
+    ts->timeouts.d[i] = n;
+    if (n.t)
+	n.t->iheap = i;
+    else
+	ts->handles.d[n.ih].iheap = i;
+}
+
+static void Timer_heap_up (TimerState* ts, size_t i, TimeoutNode n)
+{
+    for (size_t p; i && ts->timeouts.d[p = (i-1)/4].at > n.at; i = p)
+	Timer_heap_set (ts, i, ts->timeouts.d[p]);
+    Timer_heap_set (ts, i, n);
+}
+
+static void Timer_heap_down (TimerState* ts, size_t i, TimeoutNode n)
+{
+    const TimeoutNode* h = ts->timeouts.d;
+    for (size_t c, n4 = ts->timeouts.size; (c = 4*i+1) < n4;) {
+	size_t m = c;	// The earliest child
+	for (size_t j = c+1; j < c+4 && j < n4; ++j)
+	    if (h[j].at < h[m].at)
+		m = j;
+	if (h[m].at >= n.at)
+	    break;
+	Timer_heap_set (ts, i, h[m]);
+	i = m;
+    }
+    Timer_heap_set (ts, i, n);
+}
+
+static void Timer_heap_push (TimerState* ts, TimeoutNode n)
+{
+    vector_emplace_back (&ts->timeouts);
+    Timer_heap_up (ts, ts->timeouts.size-1, n);
+}
+
+static void Timer_heap_erase (TimerState* ts, size_t i)
+{
+    TimeoutNode last = ts->timeouts.d[ts->timeouts.size-1];
+    vector_pop_back (&ts->timeouts);
+    if (i >= ts->timeouts.size)
+	return;
+    if (i && ts->timeouts.d[(i-1)/4].at > last.at)
+	Timer_heap_up (ts, i, last);
+    else
+	Timer_heap_down (ts, i, last);
+}
+
+// Returns the absolute time of a timeout relative to the cached now
+static inline casytimer_t Timer_deadline (const TimerState* ts, casytimer_t timeout)
+    { return timeout > TIMER_MAX - ts->now ? TIMER_MAX : ts->now + timeout; }
+
+// Moves a deadline later by up to slack, onto a multiple of the largest
+// power of two not above it. Timeouts due close together then land on
+// the same time, and fire in one wakeup.
+static casytimer_t Timer_apply_slack (casytimer_t at, casytimer_t slack)
+{
+    if (slack < 2 || at >= TIMER_MAX)
+	return at;
+    const casytimer_t g = (casytimer_t) 1 << (63 - __builtin_clzll (slack));
+    const casytimer_t r = (at + g-1) & ~(g-1);
+    return r < TIMER_MAX ? r : at;
+}
+
+static inline casytimer_t Timer_slack (const Timer* o)
+    { return (o->cmd & WATCH_COARSE) && o->slack < TIMER_COARSE_SLACK ? TIMER_COARSE_SLACK : o->slack; }
+
+static inline casytimer_t Timer_heap_nearest (const TimerState* ts)
+    { return ts && ts->timeouts.size ? ts->timeouts.d[0].at : TIMER_MAX; }
+
+static uint32_t Timer_epoll_events (enum ETimerWatchCmd cmd)
+    { return (cmd & WATCH_READ ? EPOLLIN : 0)| (cmd & WATCH_WRITE ? EPOLLOUT : 0); }
+
+static int Timer_epoll_ctl (TimerState* ts, int op, int fd, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    int r = epoll_ctl (ts->epfd, op, fd, &ev);
+    // The kernel drops closed fds from the set, so the number may now
+    // refer to a different file, registered or not.
+    if (r < 0 && errno == ENOENT && op == EPOLL_CTL_MOD)
+	r = epoll_ctl (ts->epfd, EPOLL_CTL_ADD, fd, &ev);
+    else if (r < 0 && errno == EEXIST && op == EPOLL_CTL_ADD)
+	r = epoll_ctl (ts->epfd, EPOLL_CTL_MOD, fd, &ev);
+    return r;
+}
+
+static void Timer_ready_fd_remove (TimerState* ts, int fd)
+{
+    for (size_t i = 0; i < ts->readyfds.size; ++i) {
+	if (ts->readyfds.d[i] == fd) {
+	    ts->readyfds.d[i] = ts->readyfds.d[ts->readyfds.size-1];
+	    vector_pop_back (&ts->readyfds);
+	    break;
+	}
+    }
+    ts->fds.d[fd].alwaysready = false;
+}
+
+// Registers the union of events watched on fd by all its timers
+static void Timer_update_fd (TimerState* ts, int fd)
+{
+    FdWatch* fw = &ts->fds.d[fd];
+    uint32_t events = 0;
+    bool level = false;	// Edge triggering only if all watches want it
+    for (const Timer* t = fw->first; t; t = t->nextonfd) {
+	events |= Timer_epoll_events (t->cmd);
+	level |= !(t->cmd & WATCH_EDGE);
+    }
+    if (events && !level)
+	events |= EPOLLET;
+    if (events == fw->events)
+	return;
+    if (fw->alwaysready) {
+	if (!events)
+	    Timer_ready_fd_remove (ts, fd);
+    } else {
+	const int op = !events ? EPOLL_CTL_DEL : (fw->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+	if (0 > Timer_epoll_ctl (ts, op, fd, events) && op != EPOLL_CTL_DEL) {
+	    if (errno == EPERM) {
+		// Regular files and some devices can not be waited for.
+		// As with poll, they are always ready, and fire each pass.
+		fw->alwaysready = true;
+		vector_push_back (&ts->readyfds, &fd);
+	    } else
+		casycom_error ("failed to watch fd %d: %s", fd, strerror(errno));
+	}
+    }
+    ts->nfds += !fw->events - !events;
+    fw->events = events;
+}
+
+// Removes the watch set on o, leaving it stopped
+static void Timer_unwatch (TimerState* ts, Timer* o)
+{
+    if (o->fd >= 0 && o->cmd != WATCH_STOP) {
+	for (Timer** pt = &ts->fds.d[o->fd].first; *pt; pt = &(*pt)->nextonfd) {
+	    if (*pt == o) {
+		*pt = o->nextonfd;
+		break;
+	    }
+	}
+	o->nextonfd = NULL;
+	Timer_update_fd (ts, o->fd);
+    }
+    if (o->nextfire != TIMER_NONE)
+	Timer_heap_erase (ts, o->iheap);
+    o->cmd = WATCH_STOP;
+    o->fd = -1;
+    o->nextfire = TIMER_NONE;
+    o->period = TIMER_NONE;
+    o->fired = false;
+}
 
 //----------------------------------------------------------------------
 
-void* Timer_create (const Msg* msg)
+void Timer_init (void* vo, const Msg* msg)
 {
-    Timer* o = xalloc (sizeof(Timer));
+    Timer* o = vo;
     o->reply = casycom_create_reply_proxy (&i_TimerR, msg);
     o->nextfire = TIMER_NONE;
+    o->period = TIMER_NONE;
     o->cmd = WATCH_STOP;
     o->fd = -1;
-    vector_push_back (&_timer_watch_list, &o);
-    return o;
+    WatchList* wl = &Timer_state_get()->watch_list;
+    o->iwatch = wl->size;
+    vector_push_back (wl, &o);
 }
 
 void Timer_destroy (void* vo)
 {
     Timer* o = vo;
-    for (int i = _timer_watch_list.size; --i >= 0;)
-	if (_timer_watch_list.d[i] == o)
-	    vector_erase (&_timer_watch_list, i);
-    xfree (o);
-    if (!_timer_watch_list.size)
-	vector_deallocate (&_timer_watch_list);
+    TimerState* ts = Timer_state();
+    Timer_unwatch (ts, o);
+    WatchList* wl = &ts->watch_list;
+    Timer* last = wl->d[wl->size-1];
+    wl->d[last->iwatch = o->iwatch] = last;
+    vector_pop_back (wl);
+}
+
+void Timer_Timer_set_slack (Timer* o, casytimer_t slack)
+{
+    o->slack = slack;
 }
 
-void Timer_Timer_watch (Timer* o, enum ETimerWatchCmd cmd, int fd, casytimer_t timeoutms)
+void Timer_Timer_watch (Timer* o, enum ETimerWatchCmd cmd, int fd, casytimer_t timeout)
 {
+    TimerState* ts = Timer_state();
+    Timer_unwatch (ts, o);
     o->cmd = cmd;
     o->fd = fd;
-    if (timeoutms <= TIMER_MAX)
-	timeoutms += Timer_now();
-    o->nextfire = timeoutms;
+    if (fd >= 0 && cmd != WATCH_STOP) {
+	if (ts->fds.size <= (size_t) fd)
+	    vector_resize (&ts->fds, fd+1);
+	o->nextonfd = ts->fds.d[fd].first;
+	ts->fds.d[fd].first = o;
+	Timer_update_fd (ts, fd);
+    }
+    if (timeout <= TIMER_MAX) {
+	if (cmd & WATCH_PERSISTENT)	// Re-armed strictly later, so each check ends
+	    o->period = timeout ? timeout : 1;
+	timeout = Timer_deadline (ts, timeout);
+    }
+    if ((o->nextfire = timeout) != TIMER_NONE)
+	Timer_heap_push (ts, (TimeoutNode){ .at = Timer_apply_slack (timeout, Timer_slack (o)), .t = o });
 }
 
+//----------------------------------------------------------------------
+// Timeout handles
+
+static void Timer_timeout_free (TimerState* ts, uint32_t ih)
+{
+    TimeoutHandle* h = &ts->handles.d[ih];
+    h->fn = NULL;
+    h->arg = NULL;
+    h->iheap = ts->freehandle;
+    ts->freehandle = ih+1;
+    --ts->nhandles;
+}
+
+/// Calls fn(arg) on the loop thread timeout ns after the last wait,
+/// or up to slack ns later, to share the wakeup with other timeouts.
+/// Unlike a Timer object, a timeout takes no object or links; cancel it
+/// before arg is destroyed. The returned handle is never zero.
+casytimeout_t Timer_timeout_start_with_slack (casytimer_t timeout, casytimer_t slack, pfn_timeout fn, void* arg)
+{
+    assert (timeout <= TIMER_MAX && "a timeout must have a time");
+    TimerState* ts = Timer_state_get();
+    uint32_t ih = ts->freehandle;
+    if (ih)
+	ts->freehandle = ts->handles.d[--ih].iheap;
+    else {
+	ih = ts->handles.size;
+	vector_emplace_back (&ts->handles);
+    }
+    TimeoutHandle* h = &ts->handles.d[ih];
+    h->fn = fn;
+    h->arg = arg;
+    do { h->gen = atomic_fetch_add (&_timer_handle_gen, 1) + 1; } while (!h->gen);
+    ++ts->nhandles;
+    Timer_heap_push (ts, (TimeoutNode){ .at = Timer_apply_slack (Timer_deadline (ts, timeout), slack), .ih = ih });
+    return (casytimeout_t) h->gen << 32 | ih;
+}
+
+/// Cancels the timeout. Returns false if it has already fired.
+bool Timer_timeout_cancel (casytimeout_t t)
+{
+    TimerState* ts = Timer_state();
+    const uint32_t ih = t;
+    if (!ts || ih >= ts->handles.size || ts->handles.d[ih].gen != t >> 32 || !ts->handles.d[ih].fn)
+	return false;
+    Timer_heap_erase (ts, ts->handles.d[ih].iheap);
+    Timer_timeout_free (ts, ih);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// io_uring transfers
+
+#if USE_IO_URING
+
+static Uring* Timer_uring_create (TimerState* ts)
+{
+    struct io_uring_params p = {};
+    int fd = syscall (__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+	DEBUG_PRINTF ("[T]\tio_uring is not available: %s\n", fd < 0 ? strerror(errno) : "old kernel");
+	if (fd >= 0)
+	    close (fd);
+	ts->noring = true;
+	return NULL;
+    }
+    Uring* r = xalloc (sizeof(Uring));
+    r->fd = fd;
+    r->ringsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (r->ringsz < cqsz)
+	r->ringsz = cqsz;
+    r->sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+    char* ring = mmap (NULL, r->ringsz, PROT_READ| PROT_WRITE, MAP_SHARED| MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    r->sqes = mmap (NULL, r->sqesz, PROT_READ| PROT_WRITE, MAP_SHARED| MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+	casycom_log (LOG_ERR, "io_uring mmap: %s\n", strerror(errno));
+	exit (EXIT_FAILURE);
+    }
+    r->ring = ring;
+    r->sqentries = p.sq_entries;
+    r->sqhead = (unsigned*)(ring + p.sq_off.head);
+    r->sqtail = (unsigned*)(ring + p.sq_off.tail);
+    r->sqmask = (unsigned*)(ring + p.sq_off.ring_mask);
+    r->sqarray = (unsigned*)(ring + p.sq_off.array);
+    r->cqhead = (unsigned*)(ring + p.cq_off.head);
+    r->cqtail = (unsigned*)(ring + p.cq_off.tail);
+    r->cqmask = (unsigned*)(ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(ring + p.cq_off.cqes);
+    // Registered buffers save the kernel mapping them on every transfer,
+    // but count against the locked memory limit; work without if denied.
+    r->bufs = xalloc (URING_NBUFS * URING_BUFSZ);
+    struct iovec iov [URING_NBUFS];
+    for (unsigned i = 0; i < URING_NBUFS; ++i) {
+	iov[i].iov_base = r->bufs + i * URING_BUFSZ;
+	iov[i].iov_len = URING_BUFSZ;
+    }
+    r->fixed = !syscall (__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, URING_NBUFS);
+    // Completions make the ring fd readable, waking the epoll wait
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl (ts->epfd, EPOLL_CTL_ADD, fd, &ev);
+    return r;
+}
+
+static void Timer_uring_free (Uring** pr)
+{
+    Uring* r = *pr;
+    close (r->fd);	// Also removes it from the epoll set
+    munmap (r->sqes, r->sqesz);
+    munmap (r->ring, r->ringsz);
+    xfree (r->bufs);
+    xfree (*pr);
+}
+
+// Submits all queued sqes with one syscall
+static void Timer_uring_flush (Uring* r)
+{
+    while (r->nsubmit) {
+	int n = syscall (__NR_io_uring_enter, r->fd, r->nsubmit, 0, 0, NULL, 0);
+	if (n < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+		continue;
+	    casycom_log (LOG_ERR, "io_uring_enter: %s\n", strerror(errno));
+	    exit (EXIT_FAILURE);
+	}
+	r->nsubmit -= n;
+    }
+}
+
+static struct io_uring_sqe* Timer_uring_sqe (Uring* r)
+{
+    unsigned tail = *r->sqtail;
+    if (tail - __atomic_load_n (r->sqhead, __ATOMIC_ACQUIRE) >= r->sqentries) {
+	Timer_uring_flush (r);
+	if (tail - __atomic_load_n (r->sqhead, __ATOMIC_ACQUIRE) >= r->sqentries)
+	    return NULL;
+    }
+    unsigned i = tail & *r->sqmask;
+    struct io_uring_sqe* sqe = &r->sqes[i];
+    memset (sqe, 0, sizeof(*sqe));
+    r->sqarray[i] = i;
+    return sqe;
+}
+
+static void Timer_uring_queue (Uring* r)
+{
+    __atomic_store_n (r->sqtail, *r->sqtail + 1, __ATOMIC_RELEASE);
+    ++r->nsubmit;
+}
+
+// Calls the done function of each completed op
+static void Timer_uring_reap (Uring* r)
+{
+    for (unsigned head = *r->cqhead; head != __atomic_load_n (r->cqtail, __ATOMIC_ACQUIRE);) {
+	const struct io_uring_cqe cqe = r->cqes[head & *r->cqmask];
+	__atomic_store_n (r->cqhead, ++head, __ATOMIC_RELEASE);
+	if (!cqe.user_data)
+	    continue;	// A cancel request
+	unsigned i = cqe.user_data - 1;
+	UringOp* op = &r->ops[i];
+	--r->inflight;
+	if (op->o)	// The buffer is released after the done function uses it
+	    op->done (op->o, cqe.res, r->bufs + i * URING_BUFSZ);
+	op->busy = false;
+    }
+}
+
+static bool Timer_uring_submit (uint8_t opcode, int fd, const void* d, size_t n, pfn_uring_done done, void* o)
+{
+    TimerState* ts = Timer_state_get();
+    if (!ts->ring && (ts->noring || !(ts->ring = Timer_uring_create (ts))))
+	return false;
+    Uring* r = ts->ring;
+    unsigned i = 0;
+    while (i < URING_NBUFS && r->ops[i].busy)
+	++i;
+    struct io_uring_sqe* sqe;
+    if (i >= URING_NBUFS || !(sqe = Timer_uring_sqe (r)))
+	return false;	// Busy; the caller waits for readiness instead
+    if (n > URING_BUFSZ)
+	n = URING_BUFSZ;
+    char* buf = r->bufs + i * URING_BUFSZ;
+    if (d)
+	memcpy (buf, d, n);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = (uint64_t) -1;	// At the current position
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = n;
+    sqe->user_data = i + 1;
+    if (r->fixed) {
+	sqe->opcode = opcode == IORING_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+	sqe->buf_index = i;
+    }
+    Timer_uring_queue (r);
+    r->ops[i] = (UringOp){ .o = o, .done = done, .busy = true };
+    ++r->inflight;
+    return true;
+}
+
+/// Queues a read of up to n bytes from fd. done is called with the read
+/// result and the data. Returns false if the ring can not take it.
+bool Timer_uring_read (int fd, size_t n, pfn_uring_done done, void* o)
+    { return Timer_uring_submit (IORING_OP_READ, fd, NULL, n, done, o); }
+
+/// Queues a write of up to n bytes of d to fd; d is copied.
+bool Timer_uring_write (int fd, const void* d, size_t n, pfn_uring_done done, void* o)
+    { return Timer_uring_submit (IORING_OP_WRITE, fd, d, n, done, o); }
+
+/// Cancels the ops queued by o, waiting for the kernel to drop them
+void Timer_uring_cancel (const void* o)
+{
+    const TimerState* ts = Timer_state();
+    Uring* r = ts ? ts->ring : NULL;
+    if (!r)
+	return;
+    uint64_t cancelled = 0;
+    for (unsigned i = 0; i < URING_NBUFS; ++i) {
+	if (!r->ops[i].busy || r->ops[i].o != o)
+	    continue;
+	r->ops[i].o = NULL;
+	cancelled |= UINT64_C(1) << i;
+	struct io_uring_sqe* sqe = Timer_uring_sqe (r);
+	if (sqe) {	// Without it, the op is waited for below
+	    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	    sqe->addr = i + 1;
+	    Timer_uring_queue (r);
+	}
+    }
+    Timer_uring_flush (r);
+    for (bool busy = cancelled; busy;) {
+	syscall (__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	Timer_uring_reap (r);
+	busy = false;
+	for (unsigned i = 0; i < URING_NBUFS; ++i)
+	    if ((cancelled & (UINT64_C(1) << i)) && r->ops[i].busy)
+		busy = true;
+    }
+}
+
+#endif // USE_IO_URING
+
+//----------------------------------------------------------------------
+
 #ifndef NDEBUG
 static const char* timestring (casytimer_t t)
 {
-    t /= 1000;
     static char tbuf[32] = {};
-    #if UC_VERSION
-	ctime_r (t, tbuf);
-    #else
-	ctime_r ((const time_t*) &t, tbuf);
-    #endif
-    tbuf[strlen(tbuf)-1] = 0;	// remove newline
+    snprintf (tbuf, sizeof(tbuf), "%llu.%06llu", (unsigned long long) t / 1000000000, (unsigned long long) t % 1000000000 / 1000);
     return tbuf;
 }
 #endif
 
+// Waits for waitns when the kernel supports it, or else for waitms
+static int Timer_epoll_wait (TimerState* ts, struct epoll_event* evs, int waitms, casytimer_t waitns)
+{
+#ifdef __NR_epoll_pwait2
+    if (waitns != TIMER_NONE && !ts->nopwait2) {
+	struct __kernel_timespec t = { .tv_sec = waitns / 1000000000, .tv_nsec = waitns % 1000000000 };
+	int r = syscall (__NR_epoll_pwait2, ts->epfd, evs, TIMER_MAX_EVENTS, &t, NULL, 0);
+	if (r >= 0 || errno != ENOSYS)
+	    return r;
+	ts->nopwait2 = true;
+    }
+#endif
+    return epoll_wait (ts->epfd, evs, TIMER_MAX_EVENTS, waitms);
+}
+
+// Sends the reply and stops a one-shot watch; the object is then removed
+// in the next idle. Persistent watches stay, re-arming their timeout.
+static void Timer_fire (TimerState* ts, Timer* o, bool timedout)
+{
+    PTimerR_timer (&o->reply, o->fd);
+    if (!timedout) {
+	o->fired = true;
+	o->replyn = casycom_queued_messages (o->reply.dest);
+    }
+    if (!(o->cmd & WATCH_PERSISTENT)) {
+	Timer_unwatch (ts, o);
+	casycom_mark_unused (o);
+    } else if (o->period != TIMER_NONE) {
+	// Periodic timers keep their phase, fd events restart the timeout
+	casytimer_t next = timedout ? o->nextfire + o->period : ts->now + o->period;
+	if (next <= ts->now)	// Skipping missed periods
+	    next = ts->now + o->period;
+	Timer_heap_erase (ts, o->iheap);
+	o->nextfire = next;
+	Timer_heap_push (ts, (TimeoutNode){ .at = Timer_apply_slack (next, Timer_slack (o)), .t = o });
+    }
+}
+
+// Fires each timer waiting for the ready events on fd, or on errors.
+// Errors will be detected when the client tries to use the fd.
+// A persistent watch stays ready until its owner handles the reply,
+// and does not fire again until the reply is delivered. Only fd's own
+// watches can be removed while firing.
+static void Timer_fd_ready (TimerState* ts, int fd, uint32_t revents)
+{
+    for (Timer *t = ts->fds.d[fd].first, *tnext; t; t = tnext) {
+	tnext = t->nextonfd;
+	if (t->fired && (int32_t)(casycom_delivered_messages (t->reply.dest) - t->replyn) < 0)
+	    continue;
+	if (revents & (EPOLLERR| EPOLLHUP| Timer_epoll_events (t->cmd)))
+	    Timer_fire (ts, t, false);
+    }
+}
+
 /// Waits for timer or fd events.
-/// toWait specifies the minimum timeout in milliseconds.
+/// toWait is -1 to wait for them, or 0 to only check.
 bool Timer_run_timer (int toWait)
 {
-    if (!_timer_watch_list.size)
-	return false;
-    // Populate the fd list and find the nearest timer
-    struct pollfd fds [_timer_watch_list.size];
-    size_t nFds = 0;
-    casytimer_t nearest = TIMER_MAX;
-    for (size_t i = 0; i < _timer_watch_list.size; ++i) {
-	const Timer* we = _timer_watch_list.d[i];
-	if (we->nextfire < nearest)
-	    nearest = we->nextfire;
-	if (we->fd >= 0 && we->cmd != WATCH_STOP) {
-	    fds[nFds].fd = we->fd;
-	    fds[nFds].events = we->cmd;
-	    fds[nFds].revents = 0;
-	    ++nFds;
-	}
-    }
+    TimerState* ts = Timer_state();
+    if (!ts || !Timer_have_waits (ts))
+	return false;	// Nothing to wait for
+    const casytimer_t nearest = Timer_heap_nearest (ts);
     // Calculate how long to wait
-    if (toWait && nearest < TIMER_MAX)	// toWait could be zero, in which case don't
-	toWait = nearest - Timer_now();
-    // And wait
+    casytimer_t waitns = toWait ? TIMER_NONE : 0;
+    if (toWait && nearest < TIMER_MAX) {	// toWait could be zero, in which case don't
+	casytimer_t now = Timer_now_ns();
+	waitns = nearest > now ? nearest - now : 0;
+	// Without nanosecond waits, round up to not wake before the timer
+	casytimer_t waitms = (waitns + TIMER_NS_PER_MS-1) / TIMER_NS_PER_MS;
+	toWait = waitms < INT_MAX ? (int) waitms : INT_MAX;
+    }
+    if (ts->readyfds.size) {	// Only check when some fds are always ready
+	toWait = 0;
+	waitns = 0;
+    }
     if (DEBUG_MSG_TRACE) {
-	DEBUG_PRINTF ("[I] Waiting for %zu file descriptors from %zu timers", nFds, _timer_watch_list.size);
-	if (toWait > 0)
-	    DEBUG_PRINTF (" with %d ms timeout", toWait);
-	DEBUG_PRINTF (". %s\n", timestring(Timer_now()));
-    }
-    // And poll
-    poll (fds, nFds, toWait);
-    // Poll errors are checked for each fd with POLLERR. Other errors are ignored.
-    // poll will exit when there are fds available or when the timer expires
-    const casytimer_t now = Timer_now();
-    for (size_t i = 0, fdi = 0; i < _timer_watch_list.size; ++i) {
-	const Timer* we = _timer_watch_list.d[i];
-	bool bFired = we->nextfire <= now;	// Check timer expiration
-	if (DEBUG_MSG_TRACE && bFired) {
-	    DEBUG_PRINTF("[T]\tTimer %s", timestring(we->nextfire));
-	    DEBUG_PRINTF(" fired at %s\n", timestring(now));
+	DEBUG_PRINTF ("[I] Waiting for %zu file descriptors from %zu timers", ts->nfds, ts->watch_list.size);
+	if (waitns && waitns != TIMER_NONE)
+	    DEBUG_PRINTF (" with %llu us timeout", (unsigned long long) waitns / 1000);
+	DEBUG_PRINTF (". %s\n", timestring(Timer_now_ns()));
+    }
+#if USE_IO_URING
+    if (ts->ring)	// Queued io ops are submitted together before waiting
+	Timer_uring_flush (ts->ring);
+    const int ringfd = ts->ring ? ts->ring->fd : -1;
+#endif
+    // And wait. Errors are reported for each fd with EPOLLERR, others are ignored.
+    struct epoll_event evs [TIMER_MAX_EVENTS];
+    int nev = Timer_epoll_wait (ts, evs, toWait, waitns);
+    const casytimer_t now = ts->now = Timer_now_ns();
+    const int wakeupfd = casycom_wakeup_fd();
+    for (int e = 0; e < nev; ++e) {
+	const int fd = evs[e].data.fd;
+	const uint32_t revents = evs[e].events;
+	if (fd == wakeupfd) {
+	    uint64_t n;	// Reset the wakeup; the main loop will take the messages
+	    if (0 > read (wakeupfd, &n, sizeof(n)))
+		DEBUG_PRINTF ("[T]\tWakeup fd read failed: %s\n", strerror(errno));
+	    continue;
 	}
-	if (we->fd >= 0 && we->cmd != WATCH_STOP) {
-	    // Check if fd fired, or has errors. Errors will be detected when the client tries to use the fd.
-	    if (fds[fdi].revents & (POLLERR| we->cmd))
-		bFired = true;
-	    if (DEBUG_MSG_TRACE) {
-		if (fds[fdi].revents & POLLIN)
-		    DEBUG_PRINTF("[T]\tFile descriptor %d can be read\n", fds[fdi].fd);
-		if (fds[fdi].revents & POLLOUT)
-		    DEBUG_PRINTF("[T]\tFile descriptor %d can be written\n", fds[fdi].fd);
-		if (fds[fdi].revents & POLLMSG)
-		    DEBUG_PRINTF("[T]\tFile descriptor %d has extra data\n", fds[fdi].fd);
-		if (fds[fdi].revents & POLLERR)
-		    DEBUG_PRINTF("[T]\tFile descriptor %d has errors\n", fds[fdi].fd);
-	    }
-	    ++fdi;
+#if USE_IO_URING
+	if (fd == ringfd)
+	    continue;	// Completions are reaped below
+#endif
+	if (DEBUG_MSG_TRACE) {
+	    if (revents & EPOLLIN)
+		DEBUG_PRINTF("[T]\tFile descriptor %d can be read\n", fd);
+	    if (revents & EPOLLOUT)
+		DEBUG_PRINTF("[T]\tFile descriptor %d can be written\n", fd);
+	    if (revents & (EPOLLERR| EPOLLHUP))
+		DEBUG_PRINTF("[T]\tFile descriptor %d has errors\n", fd);
 	}
-	if (bFired) {	// Once the timer or the fd fires, it is removed
-	    PTimerR_timer (&we->reply, we->fd);
-	    casycom_mark_unused (we);	// ... in the next idle
+	Timer_fd_ready (ts, fd, revents);
+    }
+    // Fds that can not be waited for are ready each time
+    for (size_t i = ts->readyfds.size; i--;) {
+	const int fd = ts->readyfds.d[i];
+	Timer_fd_ready (ts, fd, ts->fds.d[fd].events);
+    }
+    // Check timer expiration
+    while (ts->timeouts.size && ts->timeouts.d[0].at <= now) {
+	const TimeoutNode n = ts->timeouts.d[0];
+	if (DEBUG_MSG_TRACE) {
+	    DEBUG_PRINTF("[T]\t%s %s", n.t ? "Timer" : "Timeout", timestring(n.at));
+	    DEBUG_PRINTF(" fired at %s\n", timestring(now));
+	}
+	if (n.t)
+	    Timer_fire (ts, n.t, true);	// Removes or re-arms it
+	else {
+	    const TimeoutHandle h = ts->handles.d[n.ih];
+	    Timer_heap_erase (ts, 0);
+	    Timer_timeout_free (ts, n.ih);
+	    h.fn (h.arg);
 	}
     }
-    return _timer_watch_list.size;
+#if USE_IO_URING
+    if (ts->ring)
+	Timer_uring_reap (ts->ring);
+#endif
+    return Timer_have_waits (ts);
 }
 
 size_t Timer_watch_list_size (void)
 {
-    return _timer_watch_list.size;
+    const TimerState* ts = Timer_state();
+    if (!ts)
+	return 0;
+    size_t n = ts->watch_list.size + (casycom_wakeup_fd() >= 0);
+#if USE_IO_URING
+    n += !!ts->ring;
+#endif
+    return n;
 }
 
 size_t Timer_watch_list_for_poll (struct pollfd* fds, size_t fdslen, int* timeout)
 {
     size_t nFds = 0;
-    casytimer_t nearest = TIMER_MAX;
-    for (size_t i = 0; i < _timer_watch_list.size; ++i) {
-	const Timer* we = _timer_watch_list.d[i];
-	if (we->nextfire < nearest)
-	    nearest = we->nextfire;
+    TimerState* ts = Timer_state();
+    const casytimer_t nearest = Timer_heap_nearest (ts);
+    const WatchList* wl = ts ? &ts->watch_list : NULL;
+    const int wakeupfd = casycom_wakeup_fd();
+    for (size_t i = 0; wl && i < wl->size; ++i) {
+	const Timer* we = wl->d[i];
 	if (we->fd >= 0 && we->cmd != WATCH_STOP && nFds < fdslen) {
 	    fds[nFds].fd = we->fd;
-	    fds[nFds].events = we->cmd;
+	    fds[nFds].events = we->cmd & WATCH_RDWR_TIMER;
 	    fds[nFds].revents = 0;
 	    ++nFds;
 	}
     }
+    if (wakeupfd >= 0 && wl && nFds < fdslen) {
+	fds[nFds].fd = wakeupfd;
+	fds[nFds].events = POLLIN;
+	fds[nFds].revents = 0;
+	++nFds;
+    }
+#if USE_IO_URING
+    if (ts && ts->ring && nFds < fdslen) {
+	Timer_uring_flush (ts->ring);	// Completions are reaped by Timer_run_timer
+	fds[nFds].fd = ts->ring->fd;
+	fds[nFds].events = POLLIN;
+	fds[nFds].revents = 0;
+	++nFds;
+    }
+#endif
     if (timeout) {
-	casytimer_t now = Timer_now();
-        *timeout = (now < nearest ? (int)(nearest - now) : -1);
+	casytimer_t now = Timer_now_ns(), waitms = 0;
+	if (now < nearest)
+	    waitms = (nearest - now + TIMER_NS_PER_MS-1) / TIMER_NS_PER_MS;
+	*timeout = nearest >= TIMER_MAX ? -1 : (waitms < INT_MAX ? (int) waitms : INT_MAX);
     }
     return nFds;
 }
 
-/// Returns current time in milliseconds
+/// Returns the monotonic clock time in nanoseconds
+casytimer_t Timer_now_ns (void)
+{
+    struct timespec t;
+    if (0 > clock_gettime (CLOCK_MONOTONIC, &t))
+	return 0;
+    return (casytimer_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/// Returns the wall clock time in milliseconds. Timers use Timer_now_ns.
 casytimer_t Timer_now (void)
 {
     struct timespec t;
@@ -240,10 +960,12 @@ casytimer_t Timer_now (void)
 
 static const DTimer d_Timer_Timer = {
     .interface = &i_Timer,
-    DMETHOD (Timer, Timer_watch)
+    DMETHOD (Timer, Timer_watch),
+    DMETHOD (Timer, Timer_set_slack)
 };
 const Factory f_Timer = {
-    .create	= Timer_create,
+    .init	= Timer_init,
     .destroy	= Timer_destroy,
+    .object_size = sizeof(Timer),
     .dtable	= { &d_Timer_Timer, NULL }
 };
@@ -21,28 +21,42 @@ enum ETimerWatchCmd {
     WATCH_TIMER             = POLLMSG,
     WATCH_READ_TIMER        = WATCH_READ| WATCH_TIMER,
     WATCH_WRITE_TIMER       = WATCH_WRITE| WATCH_TIMER,
-    WATCH_RDWR_TIMER        = WATCH_RDWR| WATCH_TIMER
+    WATCH_RDWR_TIMER        = WATCH_RDWR| WATCH_TIMER,
+    // A persistent watch fires on each event until stopped, instead of
+    // once. Its timeout repeats as a period, restarted by fd events.
+    WATCH_PERSISTENT        = 0x10000,
+    WATCH_EDGE              = 0x20000,	// Fire only when an fd becomes ready
+    WATCH_COARSE            = 0x40000	// Low priority; TIMER_COARSE_SLACK
 };
-typedef uint64_t casytimer_t;
+typedef uint64_t casytimer_t;	// Nanoseconds on the monotonic clock
+typedef uint64_t casytimeout_t;
+typedef void (*pfn_timeout)(void* arg);
 enum {
     TIMER_MAX = INT64_MAX,
-    TIMER_NONE = UINT64_MAX
+    TIMER_NONE = UINT64_MAX,
+    TIMER_NS_PER_MS = 1000000,
+    TIMER_COARSE_SLACK = 250*TIMER_NS_PER_MS
 };
 
 //----------------------------------------------------------------------
 // PTimer
 
 typedef void (*MFN_Timer_watch)(void* vo, enum ETimerWatchCmd cmd, int fd, casytimer_t timer);
+typedef void (*MFN_Timer_set_slack)(void* vo, casytimer_t slack);
 typedef struct _DTimer {
     iid_t		interface;
     MFN_Timer_watch	Timer_watch;
+    MFN_Timer_set_slack	Timer_set_slack;
 } DTimer;
 
 extern const Interface i_Timer;
 
 //----------------------------------------------------------------------
 
-void PTimer_watch (const Proxy* pp, enum ETimerWatchCmd cmd, int fd, casytimer_t timeoutms);
+void PTimer_watch_ns (const Proxy* pp, enum ETimerWatchCmd cmd, int fd, casytimer_t timeout);
+// Lets the timeouts of following watches fire up to slack ns late,
+// so that timeouts due close together share one wakeup.
+void PTimer_set_slack (const Proxy* pp, casytimer_t slack);
 
 //----------------------------------------------------------------------
 // PTimerR
@@ -64,9 +78,22 @@ void PTimerR_timer (const Proxy* pp, int fd);
 extern const Factory f_Timer;
 
 bool		Timer_run_timer (int toWait) noexcept;
-casytimer_t	Timer_now (void) noexcept;
+casytimer_t	Timer_now (void) noexcept;	///< Wall clock, in milliseconds
+casytimer_t	Timer_now_ns (void) noexcept;	///< Monotonic clock of timers, in ns
 size_t		Timer_watch_list_size (void) noexcept;
 size_t		Timer_watch_list_for_poll (struct pollfd* fds, size_t fdslen, int* timeout) noexcept NONNULL(1);
+casytimeout_t	Timer_timeout_start_with_slack (casytimer_t timeout, casytimer_t slack, pfn_timeout fn, void* arg) noexcept NONNULL(3);
+bool		Timer_timeout_cancel (casytimeout_t t) noexcept;
+void		Timer_state_reset (void) noexcept;	///< For main.c
+
+#if USE_IO_URING
+// Called with the result of the transfer, and the data it read.
+typedef void (*pfn_uring_done)(void* o, int r, const void* d);
+
+bool		Timer_uring_read (int fd, size_t n, pfn_uring_done done, void* o) noexcept NONNULL(3,4);
+bool		Timer_uring_write (int fd, const void* d, size_t n, pfn_uring_done done, void* o) noexcept NONNULL(2,4,5);
+void		Timer_uring_cancel (const void* o) noexcept NONNULL();
+#endif
 
 //----------------------------------------------------------------------
 // PTimer inlines
@@ -75,6 +102,13 @@ size_t		Timer_watch_list_for_poll (struct pollfd* fds, size_t fdslen, int* timeo
 namespace {
 #endif
 
+// Millisecond timeouts, converted to nanoseconds. TIMER_NONE is kept.
+static inline casytimer_t Timer_ms_to_ns (casytimer_t ms)
+    { return ms > TIMER_MAX / TIMER_NS_PER_MS ? (ms > TIMER_MAX ? TIMER_NONE : TIMER_MAX) : ms * TIMER_NS_PER_MS; }
+static inline void PTimer_watch (const Proxy* pp, enum ETimerWatchCmd cmd, int fd, casytimer_t timeoutms)
+    { PTimer_watch_ns (pp, cmd, fd, Timer_ms_to_ns (timeoutms)); }
+static inline void PTimer_timer_ns (const Proxy* pp, casytimer_t timeout)
+    { PTimer_watch_ns (pp, WATCH_TIMER, -1, timeout); }
 static inline void PTimer_stop (const Proxy* pp)
     { PTimer_watch (pp, WATCH_STOP, -1, TIMER_NONE); }
 static inline void PTimer_timer (const Proxy* pp, casytimer_t timeoutms)
@@ -91,6 +125,18 @@ static inline void PTimer_wait_write_with_timeout (const Proxy* pp, int fd, casy
     { PTimer_watch (pp, WATCH_WRITE_TIMER, fd, timeoutms); }
 static inline void PTimer_wait_rdwr_with_timeout (const Proxy* pp, int fd, casytimer_t timeoutms)
     { PTimer_watch (pp, WATCH_RDWR_TIMER, fd, timeoutms); }
+static inline void PTimer_periodic (const Proxy* pp, casytimer_t periodms)
+    { PTimer_watch (pp, WATCH_TIMER| WATCH_PERSISTENT, -1, periodms); }
+static inline void PTimer_periodic_ns (const Proxy* pp, casytimer_t period)
+    { PTimer_watch_ns (pp, WATCH_TIMER| WATCH_PERSISTENT, -1, period); }
+static inline casytimeout_t Timer_timeout_start (casytimer_t timeout, pfn_timeout fn, void* arg)
+    { return Timer_timeout_start_with_slack (timeout, 0, fn, arg); }
+static inline void PTimer_watch_read (const Proxy* pp, int fd)
+    { PTimer_watch (pp, WATCH_READ| WATCH_PERSISTENT, fd, TIMER_NONE); }
+static inline void PTimer_watch_write (const Proxy* pp, int fd)
+    { PTimer_watch (pp, WATCH_WRITE| WATCH_PERSISTENT, fd, TIMER_NONE); }
+static inline void PTimer_watch_rdwr (const Proxy* pp, int fd)
+    { PTimer_watch (pp, WATCH_RDWR| WATCH_PERSISTENT, fd, TIMER_NONE); }
 
 #ifdef __cplusplus
 } // namespace
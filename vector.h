@@ -97,6 +97,10 @@ static inline NONNULL() size_t vector_insert_sorted (void* vv, vector_compare_fn
 static inline NONNULL() void vector_sort (void* vv, vector_compare_fn_t cmp)
     { CharVector* v = vv; qsort (v->d, v->size, v->elsize, cmp); }
 
+// Multiplicative hash of an integer or pointer key, for hash indexes
+static inline size_t hash_index_mix (uint64_t k)
+    { return (k * UINT64_C(0x9E3779B97F4A7C15)) >> 32; }
+
 #ifdef __cplusplus
 } // namespace
 #endif
@@ -128,3 +132,84 @@ static inline NONNULL() void vector_sort (void* vv, vector_compare_fn_t cmp)
 	void vtype##_erase_n (vtype* v, size_t ep, size_t n);\
 	void vtype##_clear (vtype* v);	\
 	void vtype##_dtor (vtype* v)
+
+//----------------------------------------------------------------------
+
+// Declares an open addressing hash index with entries of the given type.
+// It is a vector of buckets, usable with the vector_ functions, and the
+// count of the used ones. Empty buckets have all zero bytes.
+#define DECLARE_HASH_INDEX_TYPE(name,type)	\
+typedef struct _##name {		\
+    type* const		d;		\
+    const size_t	size;		\
+    const size_t	allocated;	\
+    const size_t	elsize;		\
+    size_t		used;		\
+} name
+
+#define HASH_INDEX_INIT(itype)		VECTOR_INIT(itype)
+#define HASH_INDEX_MEMBER_INIT(itype,name)	\
+	do { VECTOR_MEMBER_INIT (itype, name); (name).used = 0; } while (false)
+
+// This template macro generates find, insert, erase, and deallocate for
+// a hash index of etype entries. Entries are usually indexes into a table
+// in the context ctype, where key_of(c,e), a macro or a function, finds
+// the ktype key of entry e. hash(k) returns the hash of a key, and
+// equal(k1,k2) compares two keys. The index is kept at most half full,
+// so lookups stop at the first empty bucket.
+#define IMPLEMENT_HASH_INDEX(scope,itype,etype,ctype,ktype,key_of,hash,equal)\
+	static inline bool itype##_empty (const etype* e)\
+	    { static const etype z = {0}; return !memcmp (e, &z, sizeof(z)); }\
+	/* Returns the bucket of the entry with key k, or SIZE_MAX */\
+	scope size_t itype##_find (const ctype* c UNUSED, const itype* x, ktype k)\
+	{					\
+	    if (!x->used)			\
+		return SIZE_MAX;		\
+	    const size_t mask = x->size-1;	\
+	    for (size_t i = hash (k) & mask;; i = (i+1) & mask) {\
+		if (itype##_empty (&x->d[i]))	\
+		    return SIZE_MAX;		\
+		if (equal (key_of (c, x->d[i]), k))\
+		    return i;			\
+	    }					\
+	}					\
+	static void itype##_place (const ctype* c UNUSED, itype* x, etype e)\
+	{					\
+	    const size_t mask = x->size-1;	\
+	    size_t i = hash (key_of (c, e)) & mask;\
+	    while (!itype##_empty (&x->d[i]))	\
+		i = (i+1) & mask;		\
+	    x->d[i] = e;			\
+	}					\
+	/* Adds e, which must not yet be in the index */\
+	scope void itype##_insert (const ctype* c UNUSED, itype* x, etype e)\
+	{					\
+	    if (2*(x->used+1) > x->size) {	\
+		itype oldx = HASH_INDEX_INIT (itype);	/* Grow the index and rehash all entries */\
+		vector_swap (&oldx, x);		\
+		vector_resize (x, oldx.size ? 2*oldx.size : 16);\
+		for (size_t i = 0; i < oldx.size; ++i)\
+		    if (!itype##_empty (&oldx.d[i]))\
+			itype##_place (c, x, oldx.d[i]);\
+		vector_deallocate (&oldx);	\
+	    }					\
+	    itype##_place (c, x, e);		\
+	    ++x->used;				\
+	}					\
+	/* Removes the entry in bucket i, returned by find */\
+	scope void itype##_erase (const ctype* c UNUSED, itype* x, size_t i)\
+	{					\
+	    /* Shift back following entries in the collision chain to fill the hole */\
+	    const size_t mask = x->size-1;	\
+	    for (size_t j = (i+1) & mask; !itype##_empty (&x->d[j]); j = (j+1) & mask) {\
+		size_t k = hash (key_of (c, x->d[j])) & mask;\
+		if (((j-k) & mask) >= ((j-i) & mask)) {	/* k is not cyclically in (i,j] */\
+		    x->d[i] = x->d[j];		\
+		    i = j;			\
+		}				\
+	    }					\
+	    memset (&x->d[i], 0, sizeof(x->d[i]));\
+	    --x->used;				\
+	}					\
+	scope void itype##_deallocate (itype* x)\
+	    { vector_deallocate (x); x->used = 0; }
@@ -0,0 +1,203 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#include "work.h"
+#include <pthread.h>
+#include <signal.h>
+
+//----------------------------------------------------------------------
+// Work interface
+
+enum { method_Work_run };
+
+void PWork_run (const Proxy* pp, pfn_work fn, void* arg)
+{
+    assert (pp->interface == &i_Work && "the given proxy is for a different interface");
+    Msg* msg = casymsg_begin (pp, method_Work_run, 16);
+    WStm os = casymsg_write (msg);
+    casystm_write_ptr (&os, (const void*)(uintptr_t) fn);
+    casystm_write_ptr (&os, arg);
+    casymsg_end (msg);
+}
+
+static void Work_dispatch (const DWork* dtable, void* o, const Msg* msg)
+{
+    if (msg->imethod == method_Work_run) {
+	RStm is = casymsg_read (msg);
+	pfn_work fn = (pfn_work)(uintptr_t) casystm_read_ptr (&is);
+	void* arg = casystm_read_ptr (&is);
+	dtable->Work_run (o, fn, arg);
+    } else
+	casymsg_default_dispatch (dtable, o, msg);
+}
+
+const Interface i_Work = {
+    .name	= "Work",
+    .dispatch	= Work_dispatch,
+    .method	= { "run\0xx", NULL }
+};
+
+//----------------------------------------------------------------------
+// WorkR interface
+
+enum { method_WorkR_done };
+
+void PWorkR_done (const Proxy* pp, void* arg)
+{
+    Msg* msg = casymsg_begin (pp, method_WorkR_done, 8);
+    WStm os = casymsg_write (msg);
+    casystm_write_ptr (&os, arg);
+    casymsg_end (msg);
+}
+
+static void WorkR_dispatch (const DWorkR* dtable, void* o, const Msg* msg)
+{
+    if (msg->imethod == method_WorkR_done) {
+	RStm is = casymsg_read (msg);
+	void* arg = casystm_read_ptr (&is);
+	dtable->WorkR_done (o, arg);
+    } else
+	casymsg_default_dispatch (dtable, o, msg);
+}
+
+const Interface i_WorkR = {
+    .name	= "WorkR",
+    .dispatch	= WorkR_dispatch,
+    .method	= { "done\0x", NULL }
+};
+
+//----------------------------------------------------------------------
+// The work pool
+
+// Jobs are queued in order, and run by a fixed number of threads shared
+// by all casycom contexts. The threads are started as needed, and block
+// all signals, which are handled by the loop thread. Each job replies to
+// the context that queued it.
+typedef struct _WorkJob {
+    struct _WorkJob*	next;
+    pfn_work		fn;
+    void*		arg;
+    CasycomContext*	ctx;
+    Proxy		reply;
+} WorkJob;
+
+static pthread_mutex_t _work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _work_cond = PTHREAD_COND_INITIALIZER;
+static WorkJob* _work_first = NULL;
+static WorkJob* _work_last = NULL;
+static unsigned _work_nthreads = 0;	// Threads started
+static unsigned _work_nidle = 0;	// ... and waiting for jobs
+static unsigned _work_nqueued = 0;	// Jobs not yet taken by a thread
+static unsigned _work_pool_size = 0;	// When 0, the number of online cpus
+
+/// Sets the number of threads in the work pool; only before it is used
+void Work_set_pool_size (unsigned n)
+{
+    pthread_mutex_lock (&_work_lock);
+    assert (!_work_nthreads && "the work pool is already running");
+    _work_pool_size = n;
+    pthread_mutex_unlock (&_work_lock);
+}
+
+static void* Work_thread (void* unused UNUSED)
+{
+    pthread_mutex_lock (&_work_lock);
+    for (;;) {
+	while (!_work_first) {
+	    ++_work_nidle;
+	    pthread_cond_wait (&_work_cond, &_work_lock);
+	    --_work_nidle;
+	}
+	WorkJob* j = _work_first;
+	if (!(_work_first = j->next))
+	    _work_last = NULL;
+	--_work_nqueued;
+	pthread_mutex_unlock (&_work_lock);
+	j->fn (j->arg);
+	// The reply is sent to the context that queued the job
+	casycom_set_context (j->ctx);
+	PWorkR_done (&j->reply, j->arg);
+	casycom_async_end();
+	casycom_set_context (NULL);
+	xfree (j);
+	pthread_mutex_lock (&_work_lock);
+    }
+    return NULL;
+}
+
+// Called with _work_lock held
+static void Work_start_thread (void)
+{
+    if (!_work_pool_size) {
+	long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+	_work_pool_size = ncpus > 0 ? ncpus : 1;
+    }
+    if (_work_nthreads >= _work_pool_size)
+	return;
+    sigset_t allsigs, oldsigs;	// The new thread inherits the mask
+    sigfillset (&allsigs);
+    pthread_sigmask (SIG_SETMASK, &allsigs, &oldsigs);
+    pthread_t t;
+    int r = pthread_create (&t, NULL, Work_thread, NULL);
+    pthread_sigmask (SIG_SETMASK, &oldsigs, NULL);
+    if (r) {
+	casycom_log (LOG_ERR, "failed to create work thread: %s\n", strerror(r));
+	exit (EXIT_FAILURE);
+    }
+    pthread_detach (t);
+    ++_work_nthreads;
+}
+
+static void Work_queue_job (WorkJob* j)
+{
+    pthread_mutex_lock (&_work_lock);
+    if (_work_last)
+	_work_last->next = j;
+    else
+	_work_first = j;
+    _work_last = j;
+    // Idle threads are counted until they wake, so a thread is started
+    // for each job queued beyond the ones they will take.
+    if (++_work_nqueued > _work_nidle)
+	Work_start_thread();
+    pthread_cond_signal (&_work_cond);
+    pthread_mutex_unlock (&_work_lock);
+}
+
+//----------------------------------------------------------------------
+// The Work server object
+
+typedef struct _Work {
+    Proxy	reply;
+} Work;
+
+static void Work_init (void* vo, const Msg* msg)
+{
+    Work* o = vo;
+    o->reply = casycom_create_reply_proxy (&i_WorkR, msg);
+}
+
+static void Work_Work_run (Work* o, pfn_work fn, void* arg)
+{
+    WorkJob* j = xalloc (sizeof(WorkJob));
+    j->fn = fn;
+    j->arg = arg;
+    j->ctx = casycom_context();
+    j->reply = o->reply;
+    casycom_async_begin();	// The loop will wait for the reply
+    Work_queue_job (j);
+}
+
+//----------------------------------------------------------------------
+
+static const DWork d_Work_Work = {
+    .interface = &i_Work,
+    DMETHOD (Work, Work_run)
+};
+const Factory f_Work = {
+    .init	= Work_init,
+    .object_size = sizeof(Work),
+    .dtable	= { &d_Work_Work, NULL }
+};
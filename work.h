@@ -0,0 +1,54 @@
+// This file is part of the casycom project
+//
+// Copyright (c) 2015 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the ISC license.
+
+#pragma once
+#include "main.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------------------------------------------
+// PWork
+
+typedef void (*pfn_work)(void* arg);
+
+typedef void (*MFN_Work_run)(void* vo, pfn_work fn, void* arg);
+typedef struct _DWork {
+    iid_t		interface;
+    MFN_Work_run	Work_run;
+} DWork;
+
+extern const Interface i_Work;
+
+//----------------------------------------------------------------------
+
+// Calls fn(arg) on a thread from the work pool, replying with WorkR_done.
+// arg must remain valid until then, and is not otherwise accessed.
+void PWork_run (const Proxy* pp, pfn_work fn, void* arg) noexcept NONNULL(1,2);
+
+//----------------------------------------------------------------------
+// PWorkR
+
+typedef void (*MFN_WorkR_done)(void* vo, void* arg);
+typedef struct _DWorkR {
+    iid_t		interface;
+    MFN_WorkR_done	WorkR_done;
+} DWorkR;
+
+extern const Interface i_WorkR;
+
+//----------------------------------------------------------------------
+
+void PWorkR_done (const Proxy* pp, void* arg) noexcept NONNULL(1);
+
+//----------------------------------------------------------------------
+
+extern const Factory f_Work;
+
+void	Work_set_pool_size (unsigned n) noexcept;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
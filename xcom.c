@@ -276,7 +276,13 @@ const Interface i_ExternR = {
 
 DECLARE_VECTOR_TYPE (MsgVector, Msg*);
 
-enum { MAX_MSG_HEADER_SIZE = UINT8_MAX-8 };
+enum {
+    MAX_MSG_HEADER_SIZE = UINT8_MAX-8,
+    MAX_GATHERED_MESSAGES = 64,		// Written with one sendmsg
+    GATHERED_HEADERS_SIZE = 4096,
+    INPUT_BUFFER_SIZE = 64*1024,	// Read with one recvmsg
+    MAX_COMPACT_IDS = 4096		// Keeps the last id byte 0, as a header end
+};
 
 enum {
     extid_COM,
@@ -293,11 +299,35 @@ typedef struct _ExtMsgHeader {
     uint8_t	hsz;		///< Full size of header
 } ExtMsgHeader;
 
+// With the compact protocol extension, negotiated in COM_export, the
+// full header sent with the first message of each method also defines
+// a numeric id for it. Later messages carry only the id.
+typedef struct _ExtMsgHeaderCompact {
+    ExtMsgHeader	h;	///< h.hsz is the size of this header
+    uint32_t		id;	///< Method id defined by the sender
+} ExtMsgHeaderCompact;
+
 typedef union _ExtMsgHeaderBuf {
     ExtMsgHeader	h;
+    ExtMsgHeaderCompact	c;
     char		d [MAX_MSG_HEADER_SIZE];
 } ExtMsgHeaderBuf;
 
+// Compact ids are indexes+1 in a vector of these
+typedef struct _ExtMethodId {
+    iid_t	interface;
+    uint32_t	imethod;
+} ExtMethodId;
+
+DECLARE_VECTOR_TYPE (ExtMethodIdVector, ExtMethodId);
+
+// Hash index of compact ids by interface and method, with 0 in empty buckets
+DECLARE_HASH_INDEX_TYPE (ExtMethodIdIndex, uint32_t);
+
+// Protocol extensions supported are listed in COM_export after the
+// interfaces, starting with a '+', which no interface name does.
+static const char c_Extern_compact_option[] = "+compact";
+
 typedef struct _COMConn {
     Proxy	proxy;
     uint16_t	extid;
@@ -305,6 +335,9 @@ typedef struct _COMConn {
 
 DECLARE_VECTOR_TYPE (COMConnVector, COMConn);
 
+// Hash index of conns indexes+1 by extid, with 0 in empty buckets
+DECLARE_HASH_INDEX_TYPE (ConnIndex, uint32_t);
+
 typedef struct _Extern {
     Proxy		reply;
     int			fd;
@@ -313,52 +346,261 @@ typedef struct _Extern {
     uint32_t		inHRead;
     uint32_t		inBRead;
     Msg*		inMsg;
+    // Received data not yet parsed is in inBuf, from inBufStart to inBufEnd
+    char*		inBuf;
+    uint32_t		inBufStart;
+    uint32_t		inBufEnd;
     const iid_t*	exported_interfaces;
     const iid_t*	all_imported_interfaces;
     ExternInfo		info;
     COMConnVector	conns;
+    ConnIndex		extidindex;
+    // Queued outgoing messages are kept in a ring, outCount from outFirst.
+    // outgoing.size is the ring capacity, always a power of two.
     MsgVector		outgoing;
+    uint32_t		outFirst;
+    uint32_t		outCount;
+    ExtMsgHeaderBuf	outHBuf;	// Of the partially written message
+    uint32_t		outLastId;
+    ExtMethodIdVector	outIds;		// Defined for sent messages
+    ExtMethodIdIndex	outIdIndex;
+    ExtMethodIdVector	inIds;		// ... and for received ones
     Proxy		timer;
+    enum ETimerWatchCmd	watching;	// The persistent socket watch
+    Proxy		flushp;		// To itself, to write routed messages
+    bool		flushing;	// ... with the flush message queued
+    bool		inRouted;	// Last incoming message was routed
+    oid_t		inWaitOid;	// Relay of the last one queued instead
+    uint32_t		inWaitN;	// ... as its nth queued message
     int			inLastFd;
     ExtMsgHeaderBuf	inHBuf;
+    // Interface and method resolved from the last received header, cached
+    // with its name strings, to skip the lookup for repeated messages.
+    iid_t		inLastIface;
+    uint32_t		inLastMethod;
+    uint32_t		inLastNamesSize;
+    char		inLastNames [MAX_MSG_HEADER_SIZE-sizeof(ExtMsgHeader)];
 } Extern;
 
+static inline size_t Extern_out_id_hash (const ExtMethodId* m)
+    { return hash_index_mix ((uintptr_t) m->interface + m->imethod); }
+static inline bool Extern_out_id_equal (const ExtMethodId* m1, const ExtMethodId* m2)
+    { return m1->interface == m2->interface && m1->imethod == m2->imethod; }
+#define Extern_out_id_method(o,id)	(&(o)->outIds.d[(id)-1])
+IMPLEMENT_HASH_INDEX (static inline, ExtMethodIdIndex, uint32_t, Extern, const ExtMethodId*, Extern_out_id_method, Extern_out_id_hash, Extern_out_id_equal)
+
 DECLARE_VECTOR_TYPE (ExternsVector, Extern*);
-static VECTOR (ExternsVector, _Extern_externs);
+
+// The Extern and conn of each COMRelay, indexed by the relay oid
+typedef struct _ExternRoute {
+    Extern*	e;
+    uint32_t	iconn;
+} ExternRoute;
+DECLARE_VECTOR_TYPE (ExternRouteVector, ExternRoute);
+
+// The first Extern importing each interface, in a hash index
+typedef struct _ExternIface {
+    iid_t	iid;
+    Extern*	e;
+} ExternIface;
+DECLARE_HASH_INDEX_TYPE (ExternIfaceIndex, ExternIface);
+
+// Each casycom context has a list of its Extern objects, allocated
+// with the first and freed with the last, with the routing tables.
+typedef struct _ExternList {
+    ExternsVector	externs;
+    ExternRouteVector	routes;
+    ExternIfaceIndex	ifaceindex;
+} ExternList;
+
+static inline ExternList* Extern_externs (void)
+    { return *casycom_context_slot (CASYCOM_CONTEXT_EXTERN); }
 
 //----------------------------------------------------------------------
 
-static COMConn* Extern_COMConn_by_extid (Extern* o, uint16_t extid);
 static bool Extern_is_interface_exported (const Extern* o, iid_t iid);
 static bool Extern_is_valid_socket (Extern* o);
 static bool Extern_validate_message (Extern* o, Msg* msg);
 static bool Extern_validate_message_header (const Extern* o, const ExtMsgHeader* h);
 static bool Extern_writing (Extern* o);
+static bool Extern_lookup_in_msg_cached (const Extern* o, Msg* msg);
+static bool Extern_lookup_in_msg_id (const Extern* o, Msg* msg);
+static bool Extern_define_in_msg_id (Extern* o, const Msg* msg);
 static iid_t Extern_lookup_in_msg_interface (const Extern* o);
 static uint32_t Extern_lookup_in_msg_method (const Extern* o, const Msg* msg);
+static void Extern_cache_in_msg_names (Extern* o, const Msg* msg);
 static void Extern_Extern_close (Extern* o);
 static void Extern_queue_incoming_message (Extern* o, Msg* msg);
+static void Extern_push_outgoing_message (Extern* o, Msg* msg);
 static void Extern_queue_outgoing_message (Extern* o, Msg* msg);
+static inline Msg** Extern_outgoing_at (Extern* o, size_t i);
 static void Extern_reading (Extern* o);
 static void Extern_set_credentials_passing (Extern* o, int enable);
 static void Extern_TimerR_timer (Extern* o, int fd, const Msg* msg);
 
+//}}}2------------------------------------------------------------------
+//{{{2 Routing tables
+
+#define Extern_conn_extid(o,ci)		((o)->conns.d[(ci)-1].extid)
+#define Extern_extid_hash(extid)	hash_index_mix (extid)
+#define Extern_same_key(a,b)		((a) == (b))
+IMPLEMENT_HASH_INDEX (static inline, ConnIndex, uint32_t, Extern, uint16_t, Extern_conn_extid, Extern_extid_hash, Extern_same_key)
+
+static COMConn* Extern_COMConn_by_extid (Extern* o, uint16_t extid)
+{
+    size_t i = ConnIndex_find (o, &o->extidindex, extid);
+    return i == SIZE_MAX ? NULL : &o->conns.d[o->extidindex.d[i]-1];
+}
+
+static COMConn* Extern_COMConn_by_oid (Extern* o, oid_t oid)
+{
+    const ExternList* el = Extern_externs();
+    if (oid >= el->routes.size || el->routes.d[oid].e != o)
+	return NULL;
+    return &o->conns.d[el->routes.d[oid].iconn];
+}
+
+static void Extern_route (Extern* o, uint32_t ci)
+{
+    ExternList* el = Extern_externs();
+    oid_t oid = o->conns.d[ci].proxy.dest;
+    if (oid >= el->routes.size)
+	vector_resize (&el->routes, oid+1);
+    el->routes.d[oid] = (ExternRoute){ o, ci };
+}
+
+// Returns true if the conn was routed
+static bool Extern_unroute (Extern* o, uint32_t ci)
+{
+    ExternList* el = Extern_externs();
+    oid_t oid = o->conns.d[ci].proxy.dest;
+    if (oid >= el->routes.size || el->routes.d[oid].e != o || el->routes.d[oid].iconn != ci)
+	return false;	// Replaced by a newer conn to the same relay
+    el->routes.d[oid].e = NULL;
+    return true;
+}
+
+static void Extern_remove_conn (Extern* o, COMConn* conn)
+{
+    const uint32_t ci = conn - o->conns.d, last = o->conns.size-1;
+    ConnIndex_erase (o, &o->extidindex, ConnIndex_find (o, &o->extidindex, conn->extid));
+    Extern_unroute (o, ci);
+    if (ci != last) {	// Move the last conn into the hole
+	o->extidindex.d[ConnIndex_find (o, &o->extidindex, o->conns.d[last].extid)] = ci+1;
+	bool routed = Extern_unroute (o, last);
+	o->conns.d[ci] = o->conns.d[last];
+	if (routed)
+	    Extern_route (o, ci);
+    }
+    vector_pop_back (&o->conns);
+}
+
+static COMConn* Extern_add_conn (Extern* o, Proxy proxy, uint16_t extid)
+{
+    COMConn* stale = Extern_COMConn_by_extid (o, extid);
+    if (stale)	// Left by a relay that has been destroyed
+	Extern_remove_conn (o, stale);
+    const uint32_t ci = o->conns.size;
+    COMConn* conn = vector_emplace_back (&o->conns);
+    conn->proxy = proxy;
+    conn->extid = extid;
+    ConnIndex_insert (o, &o->extidindex, ci+1);
+    Extern_route (o, ci);
+    return conn;
+}
+
+#define Extern_iface_iid(el,ie)		((ie).iid)
+#define Extern_iface_hash(iid)		hash_index_mix ((uintptr_t)(iid))
+IMPLEMENT_HASH_INDEX (static inline, ExternIfaceIndex, ExternIface, ExternList, iid_t, Extern_iface_iid, Extern_iface_hash, Extern_same_key)
+
+static void Extern_iface_insert (ExternList* el, iid_t iid, Extern* e)
+{
+    if (ExternIfaceIndex_find (el, &el->ifaceindex, iid) != SIZE_MAX)
+	return;	// Messages go to the first Extern importing iid
+    ExternIfaceIndex_insert (el, &el->ifaceindex, (ExternIface){ iid, e });
+}
+
+static void Extern_index_interfaces (Extern* o)
+{
+    ExternList* el = Extern_externs();
+    for (size_t ii = 0; ii < o->info.interfaces.size; ++ii)
+	Extern_iface_insert (el, o->info.interfaces.d[ii], o);
+}
+
+// Removes o from the interface index, passing each interface it had
+// to the next Extern importing it.
+static void Extern_unindex_interfaces (Extern* o)
+{
+    ExternList* el = Extern_externs();
+    for (size_t ii = 0; ii < o->info.interfaces.size; ++ii) {
+	iid_t iid = o->info.interfaces.d[ii];
+	size_t i = ExternIfaceIndex_find (el, &el->ifaceindex, iid);
+	if (i == SIZE_MAX || el->ifaceindex.d[i].e != o)
+	    continue;
+	ExternIfaceIndex_erase (el, &el->ifaceindex, i);
+	for (size_t ei = 0; ei < el->externs.size; ++ei) {
+	    Extern* e = el->externs.d[ei];
+	    for (size_t eii = 0; e != o && eii < e->info.interfaces.size; ++eii) {
+		if (e->info.interfaces.d[eii] == iid) {
+		    Extern_iface_insert (el, iid, e);
+		    ei = el->externs.size;
+		    break;
+		}
+	    }
+	}
+    }
+}
+
+static Extern* Extern_find_by_interface (iid_t iid)
+{
+    const ExternList* el = Extern_externs();
+    size_t i = el ? ExternIfaceIndex_find (el, &el->ifaceindex, iid) : SIZE_MAX;
+    return i == SIZE_MAX ? NULL : el->ifaceindex.d[i].e;
+}
+
+static Extern* Extern_find_by_id (oid_t oid)
+{
+    const ExternList* el = Extern_externs();
+    return el && oid < el->routes.size ? el->routes.d[oid].e : NULL;
+}
+
+// Returns the Extern object with the given oid, if it still exists
+static Extern* Extern_find_by_oid (oid_t oid)
+{
+    const ExternList* el = Extern_externs();
+    for (size_t i = 0; el && i < el->externs.size; ++i)
+	if (el->externs.d[i]->info.oid == oid)
+	    return el->externs.d[i];
+    return NULL;
+}
+
 //}}}2------------------------------------------------------------------
 //{{{2 Interfaces
 
-static void* Extern_create (const Msg* msg)
+static void Extern_init (void* vo, const Msg* msg)
 {
-    Extern* o = xalloc (sizeof(Extern));
-    vector_push_back (&_Extern_externs, &o);
+    Extern* o = vo;
+    ExternList** pel = (ExternList**) casycom_context_slot (CASYCOM_CONTEXT_EXTERN);
+    if (!*pel) {
+	*pel = xalloc (sizeof(ExternList));
+	VECTOR_MEMBER_INIT (ExternsVector, (*pel)->externs);
+	VECTOR_MEMBER_INIT (ExternRouteVector, (*pel)->routes);
+	HASH_INDEX_MEMBER_INIT (ExternIfaceIndex, (*pel)->ifaceindex);
+    }
+    vector_push_back (&(*pel)->externs, &o);
     o->reply = casycom_create_reply_proxy (&i_ExternR, msg);
     o->info.oid = o->reply.src;
     o->fd = -1;
     o->inLastFd = -1;
     o->timer = casycom_create_proxy (&i_Timer, msg->h.dest);
+    o->flushp = casycom_create_proxy_to (&i_TimerR, msg->h.dest, msg->h.dest);
     VECTOR_MEMBER_INIT (COMConnVector, o->conns);
+    HASH_INDEX_MEMBER_INIT (ConnIndex, o->extidindex);
     VECTOR_MEMBER_INIT (InterfaceVector, o->info.interfaces);
     VECTOR_MEMBER_INIT (MsgVector, o->outgoing);
-    return o;
+    VECTOR_MEMBER_INIT (ExtMethodIdVector, o->outIds);
+    HASH_INDEX_MEMBER_INIT (ExtMethodIdIndex, o->outIdIndex);
+    VECTOR_MEMBER_INIT (ExtMethodIdVector, o->inIds);
 }
 
 static void Extern_destroy (void* vo)
@@ -373,17 +615,30 @@ static void Extern_destroy (void* vo)
 	o->inLastFd = -1;
     }
     casymsg_free (o->inMsg);
-    for (size_t i = 0; i < o->outgoing.size; ++i)
-	casymsg_free (o->outgoing.d[i]);
+    xfree (o->inBuf);
+    for (size_t i = 0; i < o->outCount; ++i)
+	casymsg_free (*Extern_outgoing_at (o, i));
     vector_deallocate (&o->outgoing);
+    vector_deallocate (&o->outIds);
+    ExtMethodIdIndex_deallocate (&o->outIdIndex);
+    vector_deallocate (&o->inIds);
+    Extern_unindex_interfaces (o);
     vector_deallocate (&o->info.interfaces);
+    for (uint32_t ci = 0; ci < o->conns.size; ++ci)
+	Extern_unroute (o, ci);
     vector_deallocate (&o->conns);
-    for (size_t ei = 0; ei < _Extern_externs.size; ++ei)
-	if (_Extern_externs.d[ei] == o)
-	    vector_erase (&_Extern_externs, ei--);
-    if (!_Extern_externs.size)
-	vector_deallocate (&_Extern_externs);
-    xfree (o);
+    ConnIndex_deallocate (&o->extidindex);
+    ExternList** pel = (ExternList**) casycom_context_slot (CASYCOM_CONTEXT_EXTERN);
+    ExternsVector* ev = &(*pel)->externs;
+    for (size_t ei = 0; ei < ev->size; ++ei)
+	if (ev->d[ei] == o)
+	    vector_erase (ev, ei--);
+    if (!ev->size) {
+	vector_deallocate (ev);
+	vector_deallocate (&(*pel)->routes);
+	ExternIfaceIndex_deallocate (&(*pel)->ifaceindex);
+	xfree (*pel);
+    }
 }
 
 static void Extern_Extern_open (Extern* o, int fd, enum EExternType atype, const iid_t* imported_interfaces, const iid_t* exported_interfaces)
@@ -402,8 +657,8 @@ static void Extern_Extern_open (Extern* o, int fd, enum EExternType atype, const
     char exlist[256] = {}, *pexlist = &exlist[0];
     for (const iid_t* ei = o->exported_interfaces; ei && *ei; ++ei)
 	pexlist += sprintf (pexlist, "%s,", (*ei)->name);
-    assert (pexlist < &exlist[ARRAY_SIZE(exlist)] && "too many exported interfaces");
-    pexlist[-1] = 0;	// Replace last comma
+    assert (pexlist+sizeof(c_Extern_compact_option) <= &exlist[ARRAY_SIZE(exlist)] && "too many exported interfaces");
+    strcpy (pexlist, c_Extern_compact_option);	// Followed by supported extensions
     // Send the exported interfaces list in a COM_export message
     const Proxy comp = { .interface = &i_COM, .dest = o->info.oid, .src = o->info.oid };
     Extern_queue_outgoing_message (o, PCOM_export_message (&comp, exlist));
@@ -416,29 +671,11 @@ static void Extern_Extern_close (Extern* o)
 	close (o->fd);
 	o->fd = -1;
     }
-    casycom_mark_unused (o);
-}
-
-static Extern* Extern_find_by_interface (iid_t iid)
-{
-    for (size_t ei = 0; ei < _Extern_externs.size; ++ei) {
-	Extern* e = _Extern_externs.d[ei];
-	for (size_t ii = 0; ii < e->info.interfaces.size; ++ii)
-	    if (e->info.interfaces.d[ii] == iid)
-		return e;
+    if (o->watching) {
+	PTimer_stop (&o->timer);
+	o->watching = WATCH_STOP;
     }
-    return NULL;
-}
-
-static Extern* Extern_find_by_id (oid_t oid)
-{
-    for (size_t ei = 0; ei < _Extern_externs.size; ++ei) {
-	Extern* e = _Extern_externs.d[ei];
-	for (size_t ii = 0; ii < e->conns.size; ++ii)
-	    if (e->conns.d[ii].proxy.dest == oid)
-		return e;
-    }
-    return NULL;
+    casycom_mark_unused (o);
 }
 
 static void Extern_COM_error (Extern* o, const char* e, const Msg* msg UNUSED)
@@ -453,16 +690,24 @@ static void Extern_COM_export (Extern* o, const char* ilist, const Msg* msg UNUS
 {
     // The export list arrives during the handshake and contains a
     // comma-separated list of interfaces exported by the other side.
+    Extern_unindex_interfaces (o);
     vector_clear (&o->info.interfaces);	// Changing the list afterwards is also allowed.
     for (const char* iname = ilist; iname && *iname; ++ilist) {
 	if (!*ilist || *ilist == ',') {
-	    // info.interfaces contains iid_ts from all_imported_interfaces that are in ilist
-	    for (const iid_t* iii = o->all_imported_interfaces; iii && *iii; ++iii)
-		if (0 == strncmp ((*iii)->name, iname, ilist-iname))
-		    vector_push_back (&o->info.interfaces, iii);
-	    iname = ilist;
+	    size_t inamelen = ilist-iname;
+	    if (*iname == '+') {	// A protocol extension
+		if (inamelen == strlen(c_Extern_compact_option) && 0 == strncmp (c_Extern_compact_option, iname, inamelen))
+		    o->info.is_compact = true;
+	    } else {
+		// info.interfaces contains iid_ts from all_imported_interfaces that are in ilist
+		for (const iid_t* iii = o->all_imported_interfaces; iii && *iii; ++iii)
+		    if (0 == strncmp ((*iii)->name, iname, inamelen) && !(*iii)->name[inamelen])
+			vector_push_back (&o->info.interfaces, iii);
+	    }
+	    iname = ilist + !!*ilist;
 	}
     }
+    Extern_index_interfaces (o);
     // Now that the info.interfaces list is filled, the handshake is complete
     PExternR_connected (&o->reply, &o->info);
 }
@@ -526,15 +771,27 @@ static void Extern_set_credentials_passing (Extern* o, int enable)
     }
 }
 
-static void Extern_TimerR_timer (Extern* o, int fd UNUSED, const Msg* msg UNUSED)
+// The socket watch stays set between events, and is only changed when
+// writing starts or stops blocking.
+static void Extern_watch (Extern* o, bool writing)
 {
-    if (o->fd >= 0)
+    enum ETimerWatchCmd tcmd = (writing ? WATCH_RDWR : WATCH_READ)| WATCH_PERSISTENT;
+    if (o->fd >= 0 && o->watching != tcmd) {
+	o->watching = tcmd;
+	PTimer_watch (&o->timer, tcmd, o->fd, TIMER_NONE);
+    }
+}
+
+// Called when the socket watch fires, and with the flush message
+// from COMRelay_route, which only needs writing.
+static void Extern_TimerR_timer (Extern* o, int fd UNUSED, const Msg* msg)
+{
+    if (msg->h.src == o->info.oid)
+	o->flushing = false;
+    else if (o->fd >= 0)
 	Extern_reading (o);
-    enum ETimerWatchCmd tcmd = WATCH_READ;
-    if (o->fd >= 0 && Extern_writing (o))
-	tcmd = WATCH_RDWR;
     if (o->fd >= 0)
-	PTimer_watch (&o->timer, tcmd, o->fd, TIMER_NONE);
+	Extern_watch (o, Extern_writing (o));
 }
 
 //}}}2------------------------------------------------------------------
@@ -543,27 +800,92 @@ static void Extern_TimerR_timer (Extern* o, int fd UNUSED, const Msg* msg UNUSED
 static DEFINE_ALIAS_CAST(cred_alias_cast, ExternCredentials)
 static DEFINE_ALIAS_CAST(int_alias_cast, int)
 
+// Parses messages received into inBuf, returning false on error. Any
+// data left in inBuf afterwards is an incomplete fixed header; a body
+// partially read is left in inMsg, to be received directly into it.
+static bool Extern_parse_input (Extern* o)
+{
+    for (;;) {
+	uint32_t avail = o->inBufEnd - o->inBufStart;
+	if (!o->inMsg) {	// Start a new message with its header
+	    if (avail < sizeof(o->inHBuf.h))
+		break;
+	    memcpy (&o->inHBuf.h, &o->inBuf[o->inBufStart], sizeof(o->inHBuf.h));
+	    if (!Extern_validate_message_header (o, &o->inHBuf.h)) {
+		casycom_error ("invalid message");
+		Extern_Extern_close (o);
+		return false;
+	    }
+	    if (avail < o->inHBuf.h.hsz)
+		break;
+	    memcpy (o->inHBuf.d, &o->inBuf[o->inBufStart], o->inHBuf.h.hsz);
+	    o->inHRead = o->inHBuf.h.hsz;
+	    o->inBufStart += o->inHBuf.h.hsz;
+	    avail -= o->inHBuf.h.hsz;
+	    o->inMsg = casymsg_begin (&o->reply, method_create_object, o->inHBuf.h.sz);
+	    o->inMsg->extid = o->inHBuf.h.extid;
+	    o->inMsg->fdoffset = o->inHBuf.h.fdoffset;
+	}
+	// Small bodies are copied out of inBuf
+	uint32_t n = o->inMsg->size - o->inBRead;
+	if (n > avail)
+	    n = avail;
+	if (n) {
+	    memcpy ((char*) o->inMsg->body + o->inBRead, &o->inBuf[o->inBufStart], n);
+	    o->inBRead += n;
+	    o->inBufStart += n;
+	}
+	if (o->inBRead < o->inMsg->size) {
+	    // inMsg is filled over several loop iterations, so can not be in the arena
+	    o->inMsg = casymsg_promote (o->inMsg);
+	    break;
+	}
+	if (DEBUG_MSG_TRACE) {
+	    DEBUG_PRINTF ("[X] message for extid %u of size %u completed:\n", o->inMsg->extid, o->inMsg->size);
+	    hexdump (o->inHBuf.d, o->inHBuf.h.hsz);
+	    hexdump (o->inMsg->body, o->inMsg->size);
+	}
+	if (!Extern_validate_message (o, o->inMsg)) {
+	    casycom_error ("invalid message");
+	    Extern_Extern_close (o);
+	    return false;
+	}
+	// If it has, queue it and reset inMsg pointer
+	if (o->inMsg)
+	    Extern_queue_incoming_message (o, o->inMsg);
+	o->inMsg = NULL;
+	o->inHRead = 0;
+	o->inBRead = 0;
+	// Clear variable header data
+	memset (&o->inHBuf.d[sizeof(o->inHBuf.h)], 0, sizeof(o->inHBuf)-sizeof(o->inHBuf.h));
+	if (o->fd < 0)	// COM messages may close the connection
+	    return false;
+    }
+    // Move the incomplete header to the front, to receive after it
+    uint32_t left = o->inBufEnd - o->inBufStart;
+    if (left && o->inBufStart)
+	memmove (o->inBuf, &o->inBuf[o->inBufStart], left);
+    o->inBufStart = 0;
+    o->inBufEnd = left;
+    return true;
+}
+
 static void Extern_reading (Extern* o)
 {
+    if (!o->inBuf)
+	o->inBuf = xalloc (INPUT_BUFFER_SIZE);
     for (;;) {	// Read until EAGAIN
-	// create iovecs for input
-	// There are three of them, representing the three parts of each
-	// message: the fixed header (2), the header strings (0), and the
-	// message body. The common case is to read the variable parts
-	// and the fixed header of the next message in each recvmsg call.
-	struct iovec iov[3] = {};
-	if (o->inHRead >= sizeof(o->inHBuf.h)) {
-	    assert (o->inMsg && "the message must be created after the fixed header is read");
-	    iov[0].iov_base = &o->inHBuf.d[o->inHRead];
-	    iov[0].iov_len = o->inHBuf.h.hsz - o->inHRead;
-	    iov[1].iov_base = (char*) o->inMsg->body + o->inBRead;
-	    iov[1].iov_len = o->inMsg->size - o->inBRead;
-	    iov[2].iov_base = &o->inHBuf.h;
-	    iov[2].iov_len = sizeof(o->inHBuf.h);
-	} else {	// Fixed header partially read
-	    iov[2].iov_base = &o->inHBuf.d[o->inHRead];
-	    iov[2].iov_len = sizeof(o->inHBuf.h) - o->inHRead;
+	// Each recvmsg fills inBuf with as many messages as will fit,
+	// which are then parsed all at once. A body too large to have
+	// been received whole is received directly into the message.
+	struct iovec iov[2] = {};
+	if (o->inMsg) {
+	    assert (o->inBufStart == o->inBufEnd && "parsed input must be entirely in inMsg");
+	    iov[0].iov_base = (char*) o->inMsg->body + o->inBRead;
+	    iov[0].iov_len = o->inMsg->size - o->inBRead;
 	}
+	iov[1].iov_base = &o->inBuf[o->inBufEnd];
+	iov[1].iov_len = INPUT_BUFFER_SIZE - o->inBufEnd;
 	// Build struct for recvmsg
 	struct msghdr mh = {
 	    .msg_iov = iov,
@@ -574,7 +896,7 @@ static void Extern_reading (Extern* o)
 	mh.msg_control = cmsgbuf;
 	mh.msg_controllen = sizeof(cmsgbuf);
 	// Receive some data
-	int br = recvmsg (o->fd, &mh, 0);
+	ssize_t br = recvmsg (o->fd, &mh, 0);
 	if (br <= 0) {
 	    if (!br || errno == ECONNRESET)	// br == 0 when remote end closes. No error then, just need to close this end too.
 		DEBUG_PRINTF ("[X] %hu.Extern: rsocket %d closed by the other end\n", o->info.oid, o->fd);
@@ -587,7 +909,7 @@ static void Extern_reading (Extern* o)
 	    }
 	    return Extern_Extern_close (o);
 	}
-	DEBUG_PRINTF ("[X] Read %d bytes from socket %d\n", br, o->fd);
+	DEBUG_PRINTF ("[X] Read %zd bytes from socket %d\n", br, o->fd);
 	// Check if ancillary data was passed
 	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
 	    if (cmsg->cmsg_type == SCM_CREDENTIALS) {
@@ -604,53 +926,13 @@ static void Extern_reading (Extern* o)
 	    }
 	}
 	// Adjust read sizes
-	unsigned hbr = br;
-	if (hbr > iov[0].iov_len)
-	    hbr = iov[0].iov_len;
-	o->inHRead += hbr;
-	br -= hbr;
-	unsigned bbr = br;
-	if (bbr > iov[1].iov_len)
-	    bbr = iov[1].iov_len;
+	size_t bbr = br;
+	if (bbr > iov[0].iov_len)
+	    bbr = iov[0].iov_len;
 	o->inBRead += bbr;
-	br -= bbr;
-	// Check if a message has been completed
-	if (o->inMsg && bbr == iov[1].iov_len) {
-	    if (DEBUG_MSG_TRACE) {
-		DEBUG_PRINTF ("[X] message for extid %u of size %u completed:\n", o->inMsg->extid, o->inMsg->size);
-		hexdump (o->inHBuf.d, o->inHBuf.h.hsz);
-		hexdump (o->inMsg->body, o->inMsg->size);
-	    }
-	    assert (o->inBRead == o->inMsg->size);
-	    if (!Extern_validate_message (o, o->inMsg)) {
-		casycom_error ("invalid message");
-		return Extern_Extern_close (o);
-	    }
-	    // If it has, queue it and reset inMsg pointer
-	    if (o->inMsg)
-		Extern_queue_incoming_message (o, o->inMsg);
-	    o->inMsg = NULL;
-	    o->inHRead = 0;
-	    o->inBRead = 0;
-	    // Clear variable header data
-	    memset (&o->inHBuf.d[sizeof(o->inHBuf.h)], 0, sizeof(o->inHBuf)-sizeof(o->inHBuf.h));
-	}
-	// Check for partial fixed header read
-	if (br) {
-	    assert (!o->inMsg && o->inHRead <= sizeof(o->inHBuf.h));
-	    o->inHRead += br;
-	}
-	// Check if a new message can be started
-	if (br && o->inHRead >= sizeof(o->inHBuf.h)) {
-	    assert (o->inHRead == sizeof(o->inHBuf.h) && !o->inMsg && "internal error: message data read, but message not complete");
-	    if (!Extern_validate_message_header (o, &o->inHBuf.h)) {
-		casycom_error ("invalid message");
-		return Extern_Extern_close (o);
-	    }
-	    o->inMsg = casymsg_begin (&o->reply, method_create_object, o->inHBuf.h.sz);
-	    o->inMsg->extid = o->inHBuf.h.extid;
-	    o->inMsg->fdoffset = o->inHBuf.h.fdoffset;
-	}
+	o->inBufEnd += br - bbr;
+	if (!Extern_parse_input (o))
+	    return;
     }
 }
 
@@ -659,8 +941,12 @@ static void Extern_reading (Extern* o)
 
 static bool Extern_validate_message_header (const Extern* o UNUSED, const ExtMsgHeader* h)
 {
-    if (h->hsz & (MESSAGE_HEADER_ALIGNMENT-1))
-	return false;
+    if (h->hsz != sizeof(ExtMsgHeaderCompact)) {	// Compact headers are shorter than any full one
+	if (h->hsz & (MESSAGE_HEADER_ALIGNMENT-1))
+	    return false;
+	if (h->hsz > MAX_MSG_HEADER_SIZE || h->hsz < sizeof(*h)+5)
+	    return false;
+    }
     if (h->sz & (MESSAGE_BODY_ALIGNMENT-1))
 	return false;
     if (h->fdoffset != NO_FD_IN_MESSAGE && h->fdoffset+4u > h->sz)
@@ -668,34 +954,30 @@ static bool Extern_validate_message_header (const Extern* o UNUSED, const ExtMsg
     return true;
 }
 
-static COMConn* Extern_COMConn_by_extid (Extern* o, uint16_t extid)
-{
-    for (size_t i = 0; i < o->conns.size; ++i)
-	if (o->conns.d[i].extid == extid)
-	    return &o->conns.d[i];
-    return NULL;
-}
-
-static COMConn* Extern_COMConn_by_oid (Extern* o, oid_t oid)
-{
-    for (size_t i = 0; i < o->conns.size; ++i)
-	if (o->conns.d[i].proxy.dest == oid)
-	    return &o->conns.d[i];
-    return NULL;
-}
-
 static bool Extern_validate_message (Extern* o, Msg* msg)
 {
     // The interface and method names are now read, so can get the local pointers for them
-    msg->h.interface = Extern_lookup_in_msg_interface (o);
-    if (!msg->h.interface) {
-	DEBUG_PRINTF ("[X] Unable to find the message interface\n");
-	return false;
-    }
-    msg->imethod = Extern_lookup_in_msg_method (o, msg);
-    if (msg->imethod == method_invalid) {
-	DEBUG_PRINTF ("[X] Invalid method index in message\n");
-	return false;
+    if (o->inHBuf.h.hsz == sizeof(ExtMsgHeaderCompact)) {
+	if (!Extern_lookup_in_msg_id (o, msg)) {
+	    DEBUG_PRINTF ("[X] Undefined method id in message\n");
+	    return false;
+	}
+    } else if (!Extern_lookup_in_msg_cached (o, msg)) {
+	msg->h.interface = Extern_lookup_in_msg_interface (o);
+	if (!msg->h.interface) {
+	    DEBUG_PRINTF ("[X] Unable to find the message interface\n");
+	    return false;
+	}
+	msg->imethod = Extern_lookup_in_msg_method (o, msg);
+	if (msg->imethod == method_invalid) {
+	    DEBUG_PRINTF ("[X] Invalid method index in message\n");
+	    return false;
+	}
+	if (!Extern_define_in_msg_id (o, msg)) {
+	    DEBUG_PRINTF ("[X] Invalid method id definition in message\n");
+	    return false;
+	}
+	Extern_cache_in_msg_names (o, msg);
     }
     // And validate the message body by signature
     size_t vmsize = casymsg_validate_signature (msg);
@@ -734,17 +1016,20 @@ static bool Extern_validate_message (Extern* o, Msg* msg)
 	    DEBUG_PRINTF ("[X] Invalid extid in message\n");
 	    return false;
 	}
-	// create the new connection object
-	conn = vector_emplace_back (&o->conns);
-	conn->proxy = casycom_create_proxy (&i_COM, o->info.oid);
-	// The remote end sets the extid
-	conn->extid = msg->extid;
+	// create the new connection object; the remote end sets the extid
+	conn = Extern_add_conn (o, casycom_create_proxy (&i_COM, o->info.oid), msg->extid);
 	PCOM_create_object (&conn->proxy);
 	DEBUG_PRINTF ("[X] New incoming connection %hu -> %hu.%s, extid %hu\n", conn->proxy.src, conn->proxy.dest, casymsg_interface_name(msg), conn->extid);
     }
     // Translate the extid into local addresses
     msg->h.src = conn->proxy.src;
     msg->h.dest = conn->proxy.dest;
+    msg->h.gen = conn->proxy.gen;
+    // Once the remote object is deleted, its relay will be too
+    if (msg->h.interface == &i_COM && msg->imethod == method_COM_delete) {
+	DEBUG_PRINTF ("[X] destroying connection with extid %hu\n", conn->extid);
+	Extern_remove_conn (o, conn);
+    }
     return true;
 }
 
@@ -755,10 +1040,75 @@ static void Extern_queue_incoming_message (Extern* o, Msg* msg)
 	casymsg_free (msg);
     } else {
 	DEBUG_PRINTF ("[X] Queueing incoming message[%u] %hu -> %hu.%s.%s\n", msg->size, msg->h.src, msg->h.dest, casymsg_interface_name(msg), casymsg_method_name(msg));
+	const oid_t dest = msg->h.dest;
+	o->inRouted = false;
 	casymsg_end (msg);
+	if (!o->inRouted) {	// Later ones must not be routed ahead of it
+	    o->inWaitOid = dest;
+	    o->inWaitN = casycom_queued_messages (dest);
+	}
     }
 }
 
+// Returns true while the last incoming message not routed waits in the queue
+static bool Extern_incoming_waiting (const Extern* o)
+{
+    if (!o->inWaitOid)
+	return false;
+    // The count restarts when the relay oid is freed, and the message dropped
+    return (int32_t)(casycom_queued_messages (o->inWaitOid) - o->inWaitN) >= 0
+	&& (int32_t)(casycom_delivered_messages (o->inWaitOid) - o->inWaitN) < 0;
+}
+
+static bool Extern_lookup_in_msg_cached (const Extern* o, Msg* msg)
+{
+    uint32_t nsz = o->inHBuf.h.hsz - sizeof(o->inHBuf.h);
+    if (!o->inLastIface || nsz != o->inLastNamesSize || memcmp (o->inLastNames, &o->inHBuf.d[sizeof(o->inHBuf.h)], nsz))
+	return false;
+    msg->h.interface = o->inLastIface;
+    msg->imethod = o->inLastMethod;
+    return true;
+}
+
+static bool Extern_lookup_in_msg_id (const Extern* o, Msg* msg)
+{
+    uint32_t id = o->inHBuf.c.id;
+    if (!id || id > o->inIds.size || !o->inIds.d[id-1].interface)
+	return false;
+    msg->h.interface = o->inIds.d[id-1].interface;
+    msg->imethod = o->inIds.d[id-1].imethod;
+    return true;
+}
+
+// A full header defines a compact id for its method with a uint32 after
+// the names, aligned to 4. Zero, as in the padding, defines none.
+// Called after the names are validated by the lookup.
+static bool Extern_define_in_msg_id (Extern* o, const Msg* msg)
+{
+    const char* mend = strnext (strnext (strnext (&o->inHBuf.d[sizeof(o->inHBuf.h)])));
+    size_t idoffset = ceilg (mend - o->inHBuf.d, sizeof(uint32_t));
+    if (idoffset+sizeof(uint32_t) > o->inHBuf.h.hsz)
+	return true;
+    uint32_t id;
+    memcpy (&id, &o->inHBuf.d[idoffset], sizeof(id));
+    if (!id)
+	return true;
+    if (id > MAX_COMPACT_IDS)
+	return false;
+    if (o->inIds.size < id)
+	vector_resize (&o->inIds, id);
+    o->inIds.d[id-1] = (ExtMethodId){ msg->h.interface, msg->imethod };
+    return true;
+}
+
+static void Extern_cache_in_msg_names (Extern* o, const Msg* msg)
+{
+    o->inLastIface = msg->h.interface;
+    o->inLastMethod = msg->imethod;
+    o->inLastNamesSize = o->inHBuf.h.hsz - sizeof(o->inHBuf.h);
+    memcpy (o->inLastNames, &o->inHBuf.d[sizeof(o->inHBuf.h)], o->inLastNamesSize);
+}
+
 static iid_t Extern_lookup_in_msg_interface (const Extern* o)
 {
     const char* iname = &o->inHBuf.d[sizeof(o->inHBuf.h)];
@@ -804,79 +1154,179 @@ static uint32_t Extern_lookup_in_msg_method (const Extern* o, const Msg* msg)
 //}}}2------------------------------------------------------------------
 //{{{2 writing
 
-static void Extern_queue_outgoing_message (Extern* o, Msg* msg)
+static inline Msg** Extern_outgoing_at (Extern* o, size_t i)
+    { return &o->outgoing.d[(o->outFirst + i) & (o->outgoing.size-1)]; }
+
+static void Extern_outgoing_push (Extern* o, Msg* msg)
+{
+    const size_t cap = o->outgoing.size;
+    if (o->outCount >= cap) {
+	vector_resize (&o->outgoing, cap ? 2*cap : 16);
+	// Move the wrapped part to after the old end, to keep it in order
+	memcpy (&o->outgoing.d[cap], o->outgoing.d, o->outFirst*sizeof(Msg*));
+    }
+    *Extern_outgoing_at (o, o->outCount++) = msg;
+}
+
+static void Extern_outgoing_pop (Extern* o)
+{
+    Msg** pmsg = Extern_outgoing_at (o, 0);
+    casymsg_free (*pmsg);
+    *pmsg = NULL;
+    o->outFirst = (o->outFirst + 1) & (o->outgoing.size-1);
+    if (!--o->outCount)
+	o->outFirst = 0;
+}
+
+// Adds msg to the outgoing ring, to be written when the socket is ready
+static void Extern_push_outgoing_message (Extern* o, Msg* msg)
 {
+    msg = casymsg_promote (msg);	// may wait in outgoing for several loop iterations
     if (msg->h.dest == o->info.oid)	// messages to the Extern object itself have extid_COM
 	msg->extid = extid_COM;
     else {
 	COMConn* conn = Extern_COMConn_by_oid (o, msg->h.dest);
 	if (!conn) {
-	    conn = vector_emplace_back (&o->conns);
 	    // create the reply proxy from Extern to the COMRelay
-	    conn->proxy = casycom_create_proxy_to (&i_COM, o->info.oid, msg->h.dest);
 	    // Extids are assigned from oid with side-based offset
-	    conn->extid = msg->h.dest + (o->info.is_client ? extid_ClientBase : extid_ServerBase);
+	    conn = Extern_add_conn (o, casycom_create_proxy_to (&i_COM, o->info.oid, msg->h.dest),
+				msg->h.dest + (o->info.is_client ? extid_ClientBase : extid_ServerBase));
 	    DEBUG_PRINTF ("[X] New outgoing connection %hu -> %hu.%s, extid %hu\n", msg->h.src, msg->h.dest, casymsg_interface_name(msg), conn->extid);
 	}
 	msg->extid = conn->extid;
 	// Once the object is deleted, the COMConn record must be recreated because it is linked to a specific object interface
 	if (msg->h.interface == &i_COM && msg->imethod == method_COM_delete) {
 	    DEBUG_PRINTF ("[X] destroying connection with extid %hu\n", conn->extid);
-	    vector_erase (&o->conns, conn - o->conns.d);
+	    Extern_remove_conn (o, conn);
+	}
+    }
+    Extern_outgoing_push (o, msg);
+}
+
+static void Extern_queue_outgoing_message (Extern* o, Msg* msg)
+{
+    Extern_push_outgoing_message (o, msg);
+    if (o->fd >= 0)	// Incoming data is read when the socket watch fires
+	Extern_watch (o, Extern_writing (o));
+}
+
+// Returns the compact id defined for the method of msg, or 0
+static uint32_t Extern_out_msg_id (Extern* o, const Msg* msg)
+{
+    const ExtMethodId* last = o->outLastId ? &o->outIds.d[o->outLastId-1] : NULL;
+    if (last && last->interface == msg->h.interface && last->imethod == msg->imethod)
+	return o->outLastId;
+    size_t i = ExtMethodIdIndex_find (o, &o->outIdIndex, &(ExtMethodId){ msg->h.interface, msg->imethod });
+    return i == SIZE_MAX ? 0 : (o->outLastId = o->outIdIndex.d[i]);
+}
+
+static void Extern_undefine_out_ids (Extern* o, uint32_t n)
+{
+    for (uint32_t id = o->outIds.size; id > n; --id)
+	ExtMethodIdIndex_erase (o, &o->outIdIndex, ExtMethodIdIndex_find (o, &o->outIdIndex, Extern_out_id_method (o, id)));
+    vector_resize (&o->outIds, n);
+    if (o->outLastId > n)
+	o->outLastId = 0;
+}
+
+// Marshals the header of msg into hbuf, returning its size. If the other
+// side accepts compact headers, defines an id for each new method, which
+// the caller must undo if the header is then not sent.
+static unsigned Extern_marshal_header (Extern* o, const Msg* msg, ExtMsgHeaderBuf* hbuf)
+{
+    memset (hbuf, 0, sizeof(*hbuf));
+    hbuf->h.sz = ceilg (msg->size, MESSAGE_BODY_ALIGNMENT);
+    hbuf->h.extid = msg->extid;
+    hbuf->h.fdoffset = msg->fdoffset;
+    uint32_t id = 0;
+    if (o->info.is_compact) {
+	if ((id = Extern_out_msg_id (o, msg))) {
+	    hbuf->c.id = id;
+	    return hbuf->h.hsz = sizeof(hbuf->c);
+	}
+	if (o->outIds.size < MAX_COMPACT_IDS) {
+	    vector_push_back (&o->outIds, &((ExtMethodId){ msg->h.interface, msg->imethod }));
+	    ExtMethodIdIndex_insert (o, &o->outIdIndex, id = o->outIds.size);
 	}
     }
-    vector_push_back (&o->outgoing, &msg);
-    Extern_TimerR_timer (o, 0, NULL);
+    char* phstr = &hbuf->d[sizeof(hbuf->h)];
+    const char* iname = casymsg_interface_name(msg);
+    const char* mname = casymsg_method_name(msg);
+    const char* msig = strnext (mname);
+    assert (sizeof(ExtMsgHeader)+strlen(iname)+1+strlen(mname)+1+strlen(msig)+1+3+sizeof(id) <= MAX_MSG_HEADER_SIZE && "the interface and method names for this message are too long to export");
+    char* phend = stpcpy (stpcpy (stpcpy (phstr, iname)+1, mname)+1, msig)+1;
+    if (id) {	// Defines the compact id, after the names
+	phend = &hbuf->d[ceilg (phend - hbuf->d, sizeof(id))];
+	memcpy (phend, &id, sizeof(id));
+	phend += sizeof(id);
+    }
+    return hbuf->h.hsz = sizeof(hbuf->h) + ceilg (phend - phstr, MESSAGE_HEADER_ALIGNMENT);
 }
 
 static bool Extern_writing (Extern* o)
 {
     // Write all queued messages
-    while (o->outgoing.size) {
-	Msg* msg = o->outgoing.d[0];
-	// Marshal message header
-	ExtMsgHeaderBuf hbuf = {};
-	hbuf.h.sz = ceilg (msg->size, MESSAGE_BODY_ALIGNMENT);
-	hbuf.h.extid = msg->extid;
-	hbuf.h.fdoffset = msg->fdoffset;
-	char* phstr = &hbuf.d[sizeof(hbuf.h)];
-	const char* iname = casymsg_interface_name(msg);
-	const char* mname = casymsg_method_name(msg);
-	const char* msig = strnext (mname);
-	assert (sizeof(ExtMsgHeader)+strlen(iname)+1+strlen(mname)+1+strlen(msig)+1 <= MAX_MSG_HEADER_SIZE && "the interface and method names for this message are too long to export");
-	char* phend = stpcpy (stpcpy (stpcpy (phstr, iname)+1, mname)+1, msig)+1;
-	hbuf.h.hsz = sizeof(hbuf.h) + ceilg (phend - phstr, MESSAGE_HEADER_ALIGNMENT);
-	// create iovecs for output
-	struct iovec iov[2] = {};
-	if (hbuf.h.hsz > o->outHWritten) {
-	    iov[0].iov_base = &hbuf.d[o->outHWritten];
-	    iov[0].iov_len = hbuf.h.hsz - o->outHWritten;
-	}
-	if (hbuf.h.sz > o->outBWritten) {
-	    iov[1].iov_base = (char*) msg->body + o->outBWritten;
-	    iov[1].iov_len = hbuf.h.sz - o->outBWritten;
+    while (o->outCount) {
+	// Gather as many queued messages as fit into one sendmsg, with
+	// their headers marshalled one after the other into hbuf. The
+	// first message may have been partially written by the last call,
+	// and its header saved in outHBuf.
+	char hbuf [GATHERED_HEADERS_SIZE];
+	uint8_t hszs [MAX_GATHERED_MESSAGES];
+	uint16_t hoffsets [MAX_GATHERED_MESSAGES];
+	uint16_t nids [MAX_GATHERED_MESSAGES];	// outIds.size before each message
+	struct iovec iov [2*MAX_GATHERED_MESSAGES];
+	const bool headstarted = o->outHWritten || o->outBWritten;
+	unsigned nmsgs = 0, niov = 0, hbufsz = 0;
+	for (; nmsgs < o->outCount && nmsgs < MAX_GATHERED_MESSAGES && hbufsz+MAX_MSG_HEADER_SIZE <= sizeof(hbuf); ++nmsgs) {
+	    const Msg* msg = *Extern_outgoing_at (o, nmsgs);
+	    if (nmsgs && msg->fdoffset != NO_FD_IN_MESSAGE)
+		break;	// A passed fd is sent with the first message
+	    nids[nmsgs] = o->outIds.size;
+	    ExtMsgHeaderBuf mhbuf, *pmh = &mhbuf;
+	    unsigned hw = 0, bw = 0;
+	    if (!nmsgs && headstarted) {
+		pmh = &o->outHBuf;
+		hw = o->outHWritten;
+		bw = o->outBWritten;
+	    } else
+		Extern_marshal_header (o, msg, pmh);
+	    const unsigned hsz = hszs[nmsgs] = pmh->h.hsz, bsz = pmh->h.sz;
+	    hoffsets[nmsgs] = hbufsz;
+	    if (hsz > hw) {
+		memcpy (&hbuf[hbufsz], &pmh->d[hw], hsz - hw);
+		iov[niov].iov_base = &hbuf[hbufsz];
+		iov[niov++].iov_len = hsz - hw;
+		hbufsz += hsz - hw;
+	    }
+	    if (bsz > bw) {
+		iov[niov].iov_base = (char*) msg->body + bw;
+		iov[niov++].iov_len = bsz - bw;
+	    }
 	}
 	// Build outgoing struct for sendmsg
 	struct msghdr mh = {
 	    .msg_iov = iov,
-	    .msg_iovlen = ARRAY_SIZE(iov)
+	    .msg_iovlen = niov
 	};
 	// Add fd if being passed
+	Msg* firstmsg = *Extern_outgoing_at (o, 0);
 	char fdbuf [CMSG_SPACE(sizeof(int))] = {};
 	int fdpassed = -1;
-	if (hbuf.h.fdoffset != NO_FD_IN_MESSAGE) {
+	if (firstmsg->fdoffset != NO_FD_IN_MESSAGE) {
 	    mh.msg_control = fdbuf;
 	    mh.msg_controllen = sizeof(fdbuf);
 	    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
 	    cmsg->cmsg_len = sizeof(fdbuf);
 	    cmsg->cmsg_level = SOL_SOCKET;
 	    cmsg->cmsg_type = SCM_RIGHTS;
-	    fdpassed = *int_alias_cast((char*) msg->body + hbuf.h.fdoffset);
+	    fdpassed = *int_alias_cast((char*) firstmsg->body + firstmsg->fdoffset);
 	    *int_alias_cast(CMSG_DATA (cmsg)) = fdpassed;
 	}
 	// And try writing it all
-	int bw = sendmsg (o->fd, &mh, MSG_NOSIGNAL);
+	ssize_t bw = sendmsg (o->fd, &mh, MSG_NOSIGNAL);
 	if (bw <= 0) {
+	    Extern_undefine_out_ids (o, nids[0]);	// None of the ids defined were sent
 	    if (!bw || errno == ECONNRESET)	// bw == 0 when remote end closes. No error then, just need to close this end too.
 		DEBUG_PRINTF ("[X] %hu.Extern: wsocket %d closed by the other end\n", o->info.oid, o->fd);
 	    else {
@@ -889,29 +1339,45 @@ static bool Extern_writing (Extern* o)
 	    Extern_Extern_close (o);
 	    return false;
 	}
-	DEBUG_PRINTF ("[X] Wrote %d of %u bytes of message %s.%s to socket %d\n", bw, hbuf.h.hsz+hbuf.h.sz, casymsg_interface_name(msg), casymsg_method_name(msg), o->fd);
-	// Adjust written sizes
-	unsigned hbw = bw;
-	if (hbw > iov[0].iov_len)
-	    hbw = iov[0].iov_len;
-	o->outHWritten += hbw;
-	bw -= hbw;
-	o->outBWritten += bw;
-	assert (o->outBWritten <= hbuf.h.sz && "sendmsg wrote more than given");
+	DEBUG_PRINTF ("[X] Wrote %zd bytes of %u messages to socket %d\n", bw, nmsgs, o->fd);
 	// close the fd once successfully passed
 	if (fdpassed >= 0) {
 	    close (fdpassed);
 	    fdpassed = -1;
 	    // And prevent it being passed more than once
-	    msg->fdoffset = NO_FD_IN_MESSAGE;
+	    firstmsg->fdoffset = NO_FD_IN_MESSAGE;
 	}
-	// Check if message has been fully written, and move to the next one if so
-	if (o->outBWritten >= hbuf.h.sz) {
+	// Adjust written sizes, and remove fully written messages
+	unsigned i = 0;
+	for (; i < nmsgs && bw; ++i) {
+	    const Msg* msg = *Extern_outgoing_at (o, 0);
+	    const unsigned hsz = hszs[i], bsz = ceilg (msg->size, MESSAGE_BODY_ALIGNMENT);
+	    size_t hbw = hsz - o->outHWritten;
+	    if (hbw > (size_t) bw)
+		hbw = bw;
+	    o->outHWritten += hbw;
+	    bw -= hbw;
+	    size_t bbw = bsz - o->outBWritten;
+	    if (bbw > (size_t) bw)
+		bbw = bw;
+	    o->outBWritten += bbw;
+	    bw -= bbw;
+	    if (o->outBWritten < bsz || o->outHWritten < hsz)
+		break;
 	    o->outHWritten = 0;
 	    o->outBWritten = 0;
-	    casymsg_free (o->outgoing.d[0]);
-	    vector_erase (&o->outgoing, 0);
+	    Extern_outgoing_pop (o);
+	}
+	assert (!bw && "sendmsg wrote more than given");
+	// The header of a partially written message is kept as it was
+	// started, since marshalling it again may give a different one.
+	if (i < nmsgs && (o->outHWritten || o->outBWritten)) {
+	    if (i || !headstarted)
+		memcpy (&o->outHBuf, &hbuf[hoffsets[i]], hszs[i]);
+	    ++i;
 	}
+	if (i < nmsgs)	// Ids defined by headers not sent are reused
+	    Extern_undefine_out_ids (o, nids[i]);
     }
     return false;
 }
@@ -921,9 +1387,10 @@ static bool Extern_writing (Extern* o)
 
 const ExternInfo* casycom_extern_info (oid_t eid)
 {
-    for (size_t ei = 0; ei < _Extern_externs.size; ++ei)
-	if (_Extern_externs.d[ei]->info.oid == eid)
-	    return &_Extern_externs.d[ei]->info;
+    const ExternList* el = Extern_externs();
+    for (size_t ei = 0; el && ei < el->externs.size; ++ei)
+	if (el->externs.d[ei]->info.oid == eid)
+	    return &el->externs.d[ei]->info;
     return NULL;
 }
 
@@ -946,8 +1413,9 @@ static const DTimerR d_Extern_TimerR = {
     DMETHOD (Extern, TimerR_timer)
 };
 static const Factory f_Extern = {
-    .create	= Extern_create,
+    .init	= Extern_init,
     .destroy	= Extern_destroy,
+    .object_size = sizeof(Extern),
     .dtable	= { &d_Extern_Extern, &d_Extern_TimerR, NULL }
 };
 //}}}2
@@ -962,9 +1430,9 @@ typedef struct _COMRelay {
 
 //----------------------------------------------------------------------
 
-static void* COMRelay_create (const Msg* msg)
+static void COMRelay_init (void* vo, const Msg* msg)
 {
-    COMRelay* o = xalloc (sizeof(COMRelay));
+    COMRelay* o = vo;
     // COM objects are created in one of two ways:
     // 1. By message going out-of-process, via the default object mechanism
     //    This results in msg->h.interface containing the imported interface.
@@ -984,7 +1452,6 @@ static void* COMRelay_create (const Msg* msg)
 	// functions directly. But having a proxy link allows object_destroyed notification.
 	casycom_create_proxy_to (&i_COM, msg->h.dest, o->externid);
     }
-    return o;
 }
 
 static void COMRelay_COM_message (void* vo, Msg* msg)
@@ -1001,13 +1468,43 @@ static void COMRelay_COM_message (void* vo, Msg* msg)
     if (msg->h.src != o->localp.dest)	// Incoming message - forward to local
 	return casymsg_forward (&o->localp, msg);
     // Outgoing message - queue in extern
-    Msg* qm = casymsg_begin (&msg->h, msg->imethod, 0);	// Need to create a new message owned here
-    *qm = *msg;
-    msg->size = 0;	// The body is now owned by qm
-    msg->body = NULL;
+    Msg* qm = casymsg_move (msg);	// Need to create a new message owned here
     Extern_queue_outgoing_message (o->pExtern, qm);
 }
 
+// Called by casycom_queue_message to pass messages through the relay
+// without waiting for the next loop iteration. COM messages, and any
+// sent before the relay is connected, are delivered to it as usual.
+// This runs in the sender's context, so outgoing messages are only
+// added to the ring. When the ring was empty, a flush message is sent
+// to the Extern, to write them in the next pass, and any write errors
+// are then its own. A non-empty ring is written when the flush message
+// already queued is delivered, or when the socket becomes writable.
+static bool COMRelay_route (void* vo, Msg* msg)
+{
+    COMRelay* o = vo;
+    if (msg->h.interface == &i_COM || msg->imethod == method_create_object || !o->pExtern || !o->localp.interface)
+	return false;
+    if (msg->h.src == o->localp.dest) {	// Outgoing message - queue in extern
+	Extern* e = o->pExtern;
+	const bool wasEmpty = !e->outCount;
+	Extern_push_outgoing_message (e, msg);
+	if (wasEmpty && !e->flushing && e->fd >= 0) {
+	    e->flushing = true;
+	    PTimerR_timer (&e->flushp, e->fd);
+	}
+    } else {	// Incoming message - requeue to local object
+	if (Extern_incoming_waiting (o->pExtern))
+	    return false;	// ... after earlier ones for other relays
+	o->pExtern->inRouted = true;
+	iid_t iid = msg->h.interface;
+	msg->h = o->localp;
+	msg->h.interface = iid;
+	casymsg_end (msg);
+    }
+    return true;
+}
+
 static void COMRelay_destroy (void* vo)
 {
     COMRelay* o = vo;
@@ -1019,7 +1516,9 @@ static void COMRelay_destroy (void* vo)
     //    further messages to remote object. Here, no message is sent.
     // 3. The Extern object is destroyed. pExtern is reset in
     //    COMRelay_object_destroyed, and no message is sent here.
-    if (o->pExtern) {
+    //    casycom_reset may destroy the link to the Extern before the
+    //    Extern, without notifying, so it is also looked up here.
+    if (o->pExtern && Extern_find_by_oid (o->externid)) {
 	const Proxy failp = {	// The message comes from the real object
 	    .interface = &i_COM,
 	    .src = o->localp.dest,
@@ -1027,7 +1526,6 @@ static void COMRelay_destroy (void* vo)
 	};
 	Extern_queue_outgoing_message (o->pExtern, PCOM_delete_message (&failp));
     }
-    xfree (o);
 }
 
 static bool COMRelay_error (void* vo, oid_t eoid, const char* msg)
@@ -1085,8 +1583,10 @@ static const DCOM d_COMRelay_COM = {
     DMETHOD (COMRelay, COM_delete)
 };
 const Factory f_COMRelay = {
-    .create		= COMRelay_create,
+    .init		= COMRelay_init,
     .destroy		= COMRelay_destroy,
+    .route		= COMRelay_route,
+    .object_size	= sizeof(COMRelay),
     .object_destroyed	= COMRelay_object_destroyed,
     .error		= COMRelay_error,
     .dtable		= { &d_COMRelay_COM, NULL }
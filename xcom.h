@@ -124,6 +124,7 @@ typedef struct _ExternInfo {
     oid_t		oid;
     bool		is_client;
     bool		is_unix_socket;
+    bool		is_compact;	// The other side accepts compact headers
 } ExternInfo;
 
 const ExternInfo* casycom_extern_info (oid_t eid) noexcept;
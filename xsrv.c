@@ -222,10 +222,7 @@ static void ExternServer_TimerR_timer (ExternServer* o, int fd, const Msg* msg U
 	DEBUG_PRINTF ("[X] Client connection accepted on fd %d\n", cfd);
 	PExtern_open (pconn, cfd, EXTERN_SERVER, NULL, o->exported_interfaces);
     }
-    if (errno == EAGAIN) {
-	DEBUG_PRINTF ("[X] Resuming wait on fd %d\n", fd);
-	PTimer_wait_read (&o->timer, fd);
-    } else {
+    if (errno != EAGAIN) {
 	DEBUG_PRINTF ("[X] Accept failed with error %s\n", strerror(errno));
 	casycom_error ("accept: %s", strerror(errno));
 	casycom_mark_unused (o);
@@ -239,6 +236,7 @@ static void ExternServer_ExternServer_open (ExternServer* o, int fd, const iid_t
     o->exported_interfaces = exported_interfaces;
     o->close_when_empty = close_when_empty;
     fcntl (o->fd, F_SETFL, O_NONBLOCK| fcntl (o->fd, F_GETFL));
+    PTimer_watch_read (&o->timer, fd);	// Persistent; fires for each new connection
     ExternServer_TimerR_timer (o, fd, NULL);
 }
 